@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Counts global heap allocations made by the benchmark process. Include from
+// exactly one translation unit per benchmark executable.
+namespace bench {
+inline std::atomic<size_t> g_allocations{0};
+
+inline size_t allocations()
+{
+    return g_allocations.load(std::memory_order_relaxed);
+}
+} // namespace bench
+
+void* operator new(std::size_t size)
+{
+    bench::g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
@@ -0,0 +1,94 @@
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <variant>
+#include "bench_alloc_counter.hpp"
+#include "aiotek_mailbox.hpp"
+
+using namespace AIOTEK;
+
+// Replica of the envelope layout before interning and header packing.
+namespace legacy {
+enum class TaskID { Unknown = 0, Sender, Receiver };
+struct ErrorEvent {
+    int code;
+    std::string message;
+};
+struct CustomEvent {
+    std::string name;
+    std::string payload;
+};
+using MailboxMessage = std::variant<SignalEvent, ErrorEvent, CustomEvent, std::string, int>;
+struct MailboxEnvelope {
+    TaskID sender;
+    TaskID receiver;
+    MailboxMessage payload;
+};
+} // namespace legacy
+
+static constexpr size_t kCacheLine = 64;
+static constexpr int kMessages = 100000;
+
+// Typical telemetry: a dotted event name longer than the SSO buffer and a
+// short value that fits inline.
+static const std::string kName = "network.state.changed";
+static const std::string kPayload = "connected";
+
+template <typename Envelope>
+static void printLayout(const char* label)
+{
+    std::printf("%-8s sizeof=%3zu align=%zu envelopes/cache-line=%.2f\n", label, sizeof(Envelope), alignof(Envelope),
+                static_cast<double>(kCacheLine) / sizeof(Envelope));
+}
+
+template <typename Produce>
+static void printAllocations(const char* label, Produce produce)
+{
+    size_t before = bench::allocations();
+    for (int i = 0; i < kMessages; ++i)
+        produce();
+    size_t allocs = bench::allocations() - before;
+    std::printf("%-34s %.2f allocs/msg\n", label, static_cast<double>(allocs) / kMessages);
+}
+
+int main()
+{
+    std::printf("cache line %zu bytes, name \"%s\" (%zu), payload \"%s\" (%zu)\n", kCacheLine, kName.c_str(), kName.size(), kPayload.c_str(),
+                kPayload.size());
+    printLayout<legacy::MailboxEnvelope>("before");
+    printLayout<MailboxEnvelope>("after");
+
+    // Same transport for both layouts: build, push into a deque, pop.
+    std::deque<legacy::MailboxEnvelope> legacyQueue;
+    std::deque<MailboxEnvelope> queue;
+    legacyQueue.emplace_back();
+    legacyQueue.pop_front();
+    queue.emplace_back();
+    queue.pop_front();
+
+    printAllocations("before: deque round-trip", [&] {
+        legacyQueue.push_back({legacy::TaskID::Sender, legacy::TaskID::Receiver, legacy::CustomEvent{kName, kPayload}});
+        legacy::MailboxEnvelope env = std::move(legacyQueue.front());
+        legacyQueue.pop_front();
+    });
+    static const EventName name(kName);
+    printAllocations("after:  deque round-trip", [&] {
+        queue.emplace_back(TaskID::Sender, TaskID::Receiver, CustomEvent{name, kPayload});
+        MailboxEnvelope env = std::move(queue.front());
+        queue.pop_front();
+    });
+    printAllocations("after:  deque round-trip (intern)", [&] {
+        queue.emplace_back(TaskID::Sender, TaskID::Receiver, CustomEvent{kName, kPayload});
+        MailboxEnvelope env = std::move(queue.front());
+        queue.pop_front();
+    });
+
+    Mailbox mailbox;
+    mailbox.emplace(TaskID::Sender, TaskID::Receiver, 0);
+    mailbox.receive();
+    printAllocations("after:  Mailbox send/receive", [&] {
+        mailbox.emplace(TaskID::Sender, TaskID::Receiver, CustomEvent{name, kPayload});
+        auto env = mailbox.receive();
+    });
+    return 0;
+}
@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "aiotek_buffer_pool.hpp"
+#include "aiotek_log.hpp"
+#include "aiotek_mailbox.hpp"
+
+using namespace AIOTEK;
+using Clock = std::chrono::steady_clock;
+
+// Mailbox throughput and latency, printed as JSON so runs against different
+// backends (or before/after a change) can be diffed by a script.
+//
+//   throughput   P producers send(), one consumer receive()s
+//   batch_drain  P producers send(), one consumer receive_batch()es
+//   pingpong     one round trip through two mailboxes, per-message latency
+//   timed_receive P producers send(), one consumer receive_for(0 ms)s; the
+//                run fails (exit status 1) if the consumer gets fewer or
+//                more envelopes than send() accepted
+//
+// Every scenario runs once per MailboxMessage type. Producer counts are 1, 2,
+// 4 and the hardware thread count.
+
+struct Options {
+    size_t messages = 200000;  // per throughput / batch_drain run
+    size_t roundtrips = 20000; // per pingpong run
+    size_t capacity = 1024;
+    size_t batch = 64;
+    bool instrumented = false;
+    std::vector<MailboxBackend> backends = {MailboxBackend::Queue, MailboxBackend::Ring};
+    std::string output;
+};
+
+struct Payload {
+    const char* name;
+    MailboxMessage prototype; // copied into every envelope sent
+};
+
+static const char* backendName(MailboxBackend backend)
+{
+    return backend == MailboxBackend::Ring ? "ring" : "queue";
+}
+
+static MailboxConfig mailboxConfig(const Options& options, MailboxBackend backend)
+{
+    MailboxConfig config;
+    config.backend = backend;
+    config.capacity = options.capacity;
+    config.overflow = MailboxOverflow::Block;
+    config.instrumented = options.instrumented;
+    return config;
+}
+
+static std::vector<size_t> producerCounts()
+{
+    size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> counts = {1, 2, 4, hardware};
+    std::sort(counts.begin(), counts.end());
+    counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+    return counts;
+}
+
+static nlohmann::json runThroughput(const Options& options, MailboxBackend backend, const Payload& payload, size_t producers, bool batched)
+{
+    Mailbox mailbox;
+    mailbox.configure(mailboxConfig(options, backend));
+
+    size_t perProducer = options.messages / producers;
+    size_t total = perProducer * producers;
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&] {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (size_t i = 0; i < perProducer; ++i)
+                mailbox.send(MailboxEnvelope(TaskID::Sender, TaskID::Receiver, payload.prototype));
+        });
+    }
+    while (ready.load() != producers)
+        std::this_thread::yield();
+
+    std::vector<MailboxEnvelope> out;
+    out.reserve(options.batch);
+    size_t received = 0;
+    size_t wakeups = 0;
+    auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+    while (received < total) {
+        if (batched) {
+            out.clear();
+            received += mailbox.receive_batch(out, options.batch);
+        } else if (mailbox.receive()) {
+            ++received;
+        }
+        ++wakeups;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (auto& thread : threads)
+        thread.join();
+
+    return {{"scenario", batched ? "batch_drain" : "throughput"},
+            {"backend", backendName(backend)},
+            {"payload", payload.name},
+            {"producers", producers},
+            {"messages", total},
+            {"seconds", seconds},
+            {"msgs_per_sec", total / seconds},
+            {"ns_per_msg", seconds * 1e9 / total},
+            {"msgs_per_receive", static_cast<double>(total) / wakeups}};
+}
+
+// Every receive_for() here times out unless an envelope is already queued,
+// so this covers the pop after a timed-out wait. A tiny mailbox with a 1 ms
+// blockTimeout and a consumer that stalls now and then also sends producers
+// through the timed-out Block path.
+static nlohmann::json runTimedReceive(const Options& options, MailboxBackend backend, const Payload& payload, size_t producers)
+{
+    Mailbox mailbox;
+    MailboxConfig config = mailboxConfig(options, backend);
+    config.capacity = 2;
+    config.blockTimeout = std::chrono::milliseconds(1);
+    mailbox.configure(config);
+
+    size_t perProducer = options.messages / producers;
+    size_t total = perProducer * producers;
+    std::atomic<size_t> finished{0};
+    std::atomic<size_t> accepted{0};
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&] {
+            for (size_t i = 0; i < perProducer; ++i) {
+                if (mailbox.send(MailboxEnvelope(TaskID::Sender, TaskID::Receiver, payload.prototype)) == MailboxStatus::Ok)
+                    accepted.fetch_add(1, std::memory_order_relaxed);
+            }
+            finished.fetch_add(1, std::memory_order_release);
+        });
+    }
+
+    // Drain until the producers are done and the mailbox is empty, without
+    // stopping at total: a send reported as failed may still have landed.
+    size_t received = 0;
+    size_t timeouts = 0;
+    while (true) {
+        if (mailbox.receive_for(std::chrono::milliseconds(0))) {
+            // Stall now and then, for 0 to 1.5 ms, so blocked producers time
+            // out and some free slots land just around their deadline.
+            if (++received % 64 == 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(500 * (received / 64 % 4)));
+        } else {
+            ++timeouts;
+            if (finished.load(std::memory_order_acquire) == producers && mailbox.depth() == 0)
+                break;
+        }
+    }
+    size_t ok = accepted.load(std::memory_order_relaxed);
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (auto& thread : threads)
+        thread.join();
+
+    return {{"scenario", "timed_receive"},
+            {"backend", backendName(backend)},
+            {"payload", payload.name},
+            {"producers", producers},
+            {"messages", total},
+            {"seconds", seconds},
+            {"timeouts", timeouts},
+            {"accepted", ok},
+            {"lost", ok > received ? ok - received : 0},
+            {"extra", received > ok ? received - ok : 0}};
+}
+
+static nlohmann::json runPingPong(const Options& options, MailboxBackend backend, const Payload& payload)
+{
+    Mailbox ping;
+    Mailbox pong;
+    ping.configure(mailboxConfig(options, backend));
+    pong.configure(mailboxConfig(options, backend));
+
+    std::thread echo([&] {
+        while (auto env = ping.receive())
+            pong.send(std::move(*env));
+    });
+
+    const size_t warmup = std::min<size_t>(1000, options.roundtrips);
+    std::vector<double> latencies;
+    latencies.reserve(options.roundtrips);
+    for (size_t i = 0; i < warmup + options.roundtrips; ++i) {
+        auto start = Clock::now();
+        ping.send(MailboxEnvelope(TaskID::Sender, TaskID::Receiver, payload.prototype));
+        auto env = pong.receive();
+        auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        if (i >= warmup && env)
+            latencies.push_back(elapsed);
+    }
+    ping.close();
+    echo.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (double latency : latencies)
+        sum += latency;
+    auto percentile = [&](double p) { return latencies.empty() ? 0.0 : latencies[static_cast<size_t>(p * (latencies.size() - 1))]; };
+
+    return {{"scenario", "pingpong"},
+            {"backend", backendName(backend)},
+            {"payload", payload.name},
+            {"roundtrips", latencies.size()},
+            {"mean_ns", latencies.empty() ? 0.0 : sum / latencies.size()},
+            {"p50_ns", percentile(0.50)},
+            {"p99_ns", percentile(0.99)},
+            {"max_ns", latencies.empty() ? 0.0 : latencies.back()}};
+}
+
+static void usage(const char* program)
+{
+    std::fprintf(stderr,
+                 "usage: %s [--messages N] [--roundtrips N] [--capacity N] [--batch N]\n"
+                 "          [--backend queue|ring|all] [--instrumented] [--output FILE]\n",
+                 program);
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        auto number = [&](size_t& field) {
+            if (!value)
+                return false;
+            field = std::strtoull(value, nullptr, 10);
+            ++i;
+            return field > 0;
+        };
+        if (!std::strcmp(arg, "--messages")) {
+            if (!number(options.messages))
+                return false;
+        } else if (!std::strcmp(arg, "--roundtrips")) {
+            if (!number(options.roundtrips))
+                return false;
+        } else if (!std::strcmp(arg, "--capacity")) {
+            if (!number(options.capacity))
+                return false;
+        } else if (!std::strcmp(arg, "--batch")) {
+            if (!number(options.batch))
+                return false;
+        } else if (!std::strcmp(arg, "--backend") && value) {
+            ++i;
+            if (!std::strcmp(value, "queue"))
+                options.backends = {MailboxBackend::Queue};
+            else if (!std::strcmp(value, "ring"))
+                options.backends = {MailboxBackend::Ring};
+            else if (std::strcmp(value, "all"))
+                return false;
+        } else if (!std::strcmp(arg, "--instrumented")) {
+            options.instrumented = true;
+        } else if (!std::strcmp(arg, "--output") && value) {
+            options.output = value;
+            ++i;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+    // The logger writes to stdout, which carries the JSON.
+    Logger::setLevel(LogLevel::ERROR);
+
+    BufferPool pool(64 * 1024, 1);
+    MutableBuffer block = pool.acquire();
+    block.setSize(block.capacity());
+    std::memset(block.data(), 0x5a, block.capacity());
+    block.info().format = BufferFormat::YUYV;
+
+    const std::string text(40, 't'); // past the std::string small buffer
+    const std::vector<Payload> payloads = {
+        {"SignalEvent", SignalEvent{1}},
+        {"ErrorEvent", ErrorEvent{-1, "bench error"}},
+        {"CustomEvent", CustomEvent{"bench.custom", text}},
+        {"string", text},
+        {"int", 42},
+        {"BufferEvent", BufferEvent{std::move(block).publish()}},
+        {"SharedEvent", SharedEvent{std::make_shared<const CustomEvent>(CustomEvent{"bench.shared", text})}},
+    };
+
+    nlohmann::json results = nlohmann::json::array();
+    size_t lost = 0;
+    size_t extra = 0;
+    for (auto backend : options.backends) {
+        for (const auto& payload : payloads) {
+            for (size_t producers : producerCounts()) {
+                results.push_back(runThroughput(options, backend, payload, producers, false));
+                results.push_back(runThroughput(options, backend, payload, producers, true));
+                results.push_back(runTimedReceive(options, backend, payload, producers));
+                lost += results.back()["lost"].get<size_t>();
+                extra += results.back()["extra"].get<size_t>();
+            }
+            results.push_back(runPingPong(options, backend, payload));
+            std::fprintf(stderr, "%s %s done\n", backendName(backend), payload.name);
+        }
+    }
+
+    nlohmann::json report = {{"benchmark", "mailbox"},
+                             {"config",
+                              {{"messages", options.messages},
+                               {"roundtrips", options.roundtrips},
+                               {"capacity", options.capacity},
+                               {"batch", options.batch},
+                               {"instrumented", options.instrumented},
+                               {"hardware_threads", std::thread::hardware_concurrency()},
+                               {"envelope_bytes", sizeof(MailboxEnvelope)}}},
+                             {"results", results}};
+
+    if (options.output.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::ofstream file(options.output);
+        if (!file) {
+            std::fprintf(stderr, "cannot write %s\n", options.output.c_str());
+            return 1;
+        }
+        file << report.dump(2) << std::endl;
+    }
+    if (lost != 0 || extra != 0) {
+        std::fprintf(stderr, "timed_receive lost %zu envelopes, received %zu more than were sent\n", lost, extra);
+        return 1;
+    }
+    return 0;
+}
@@ -1,64 +1,85 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <vector>
 #include "utils/aiotek_log.hpp"
 #include "common/aiotek_timer.hpp"
 #include "module/audio/aiotek_audio.hpp"
+#include "core/aiotek_mailbox.hpp"
+#include "core/aiotek_mailbox_ack.hpp"
+#include "core/aiotek_mailbox_rpc.hpp"
+#include "app/aiotek_task.hpp"
 
 namespace AIOTEK {
 
-class AudioTask {
+class AudioTask : public ITask {
   private:
     bool running;
-    std::thread taskThread;
+    TaskThread taskThread;
     Timer timer;
     AudioManager audioManager;
+    TaskState state;
 
   public:
     AudioTask() : running(false)
     {
     }
 
-    ~AudioTask()
+    ~AudioTask() override
     {
         stop();
     }
 
-    bool start()
+    bool start(const TaskThreadConfig& sched) override
     {
         if (running)
             return true;
 
         AIOTEK_LOG_INFO("AudioTask: Starting");
+        // stop() closed the mailbox; a restarted task receives again.
+        g_mailboxes.get(TaskID::Audio).reopen();
 
         if (!audioManager.initialize()) {
             AIOTEK_LOG_ERROR("AudioTask: Failed to initialize audio manager");
+            state.setFailed();
             return false;
         }
 
         running = true;
-        taskThread = std::thread(&AudioTask::run, this);
+        state.setRunning();
+        if (!taskThread.start("Audio", sched, [this]() { run(); })) {
+            running = false;
+            state.setFailed();
+            audioManager.shutdown();
+            return false;
+        }
         return true;
     }
 
-    void stop()
+    void stop() override
     {
         if (!running)
             return;
 
         AIOTEK_LOG_INFO("AudioTask: Stopping");
         running = false;
+        g_mailboxes.get(TaskID::Audio).close();
 
-        if (taskThread.joinable()) {
-            taskThread.join();
-        }
+        taskThread.join();
 
         audioManager.shutdown();
+        if (state.health() != TaskHealth::Failed)
+            state.setStopped();
     }
 
-    bool isRunning() const
+    TaskHealth health() const override
     {
-        return running;
+        return state.health();
+    }
+
+    TaskStats stats() const override
+    {
+        return state.stats();
     }
 
   private:
@@ -69,12 +90,20 @@ class AudioTask {
 
         if (!audioManager.startCapture()) {
             AIOTEK_LOG_ERROR("AudioTask: Failed to start audio capture");
+            state.setFailed();
             return;
         }
 
-        while (running) {
+        // The 10 ms capture period doubles as the mailbox wait.
+        Mailbox& mailbox = g_mailboxes.get(TaskID::Audio);
+        std::vector<MailboxEnvelope> batch;
+        while (running && !mailbox.closed()) {
             processAudio();
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            batch.clear();
+            mailbox.receive_batch_for(batch, 8, std::chrono::milliseconds(10));
+            for (const auto& env : batch) {
+                handleMessage(env);
+            }
         }
 
         audioManager.stopCapture();
@@ -88,6 +117,7 @@ class AudioTask {
         auto audioData = audioManager.getAudioData();
         if (!audioData.empty()) {
             audioManager.processAudio(audioData);
+            state.addProcessed();
 
             static int counter = 0;
             if (++counter % 1000 == 0) {
@@ -95,6 +125,23 @@ class AudioTask {
             }
         }
     }
+
+    void handleMessage(const MailboxEnvelope& env)
+    {
+        const auto* signal = std::get_if<SignalEvent>(&env.payload);
+        if (signal && signal->signal == 0) {
+            g_acks.ack(env);
+            return;
+        }
+        if (env.flags & kEnvelopeRequest) {
+            g_rpc.reply(env, ErrorEvent{-1, "AudioTask: unsupported request"});
+        }
+    }
 };
 
+std::unique_ptr<ITask> MakeAudioTask()
+{
+    return std::make_unique<AudioTask>();
+}
+
 } // namespace AIOTEK
@@ -1,12 +1,18 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <future>
+#include <memory>
 #include <vector>
 #include <functional>
 #include <string>
 #include "aiotek_log.hpp"
 #include "aiotek_timer.hpp"
 #include "aiotek_net_managers.hpp"
+#include "aiotek_mailbox.hpp"
+#include "aiotek_mailbox_ack.hpp"
+#include "aiotek_mailbox_scheduler.hpp"
 #include "aiotek_managers_task.hpp"
 
 extern void task_sender();
@@ -15,41 +21,319 @@ extern void task_receiver();
 namespace AIOTEK {
 
 ManagersTask::ManagersTask() : running(false) {
-    tasks.push_back({"Sender", task_sender});
-    tasks.push_back({"Receiver", task_receiver});
+    // Console input and message logging yield to capture work.
+    TaskThreadConfig console;
+    console.nice = 5;
+    console.stackSize = 256 * 1024;
+    // Capture misses samples and frames when it waits behind other work.
+    TaskThreadConfig audio;
+    audio.policy = TaskPolicy::Fifo;
+    audio.priority = 60;
+    TaskThreadConfig video;
+    video.policy = TaskPolicy::Fifo;
+    video.priority = 50;
+
+    // The console blocks on stdin; shutdown does not wait for a line.
+    tasks.push_back({"Sender", MakeFunctionTask("Sender", task_sender), TaskID::Unknown, console,
+                     TaskActivation::Eager, {"Receiver"}, std::chrono::milliseconds(200)});
+    tasks.push_back({"Receiver", MakeFunctionTask("Receiver", task_receiver), TaskID::Receiver, console});
+    // Serves snapshot commands from Video, so it stops first.
+    tasks.push_back({"MQTT", MakeMQTTTask(), TaskID::MQTT, TaskThreadConfig(), TaskActivation::Eager, {"Video"}});
+    // Pipeline tasks start when a consumer first sends them a request, e.g.
+    // Video on the first MQTT snapshot command.
+    tasks.push_back({"Video", MakeVideoTask(), TaskID::Video, video, TaskActivation::Lazy});
+    // Nothing requests audio on demand, so capture runs from boot.
+    tasks.push_back({"Audio", MakeAudioTask(), TaskID::Audio, audio});
 }
 
 ManagersTask::~ManagersTask() {
     stop();
+    // A stuck task's stop() still uses it: wait rather than free it.
+    for (auto& entry : tasks) {
+        if (entry.stopper.joinable()) {
+            entry.stopper.join();
+        }
+    }
+}
+
+static long long millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool ManagersTask::resolveDependencies() {
+    dependencies.assign(tasks.size(), {});
+    std::vector<size_t> pending(tasks.size(), 0); // dependencies not yet ordered
+    std::vector<std::vector<size_t>> dependents(tasks.size());
+    for (size_t index = 0; index < tasks.size(); ++index) {
+        for (const auto& name : tasks[index].dependsOn) {
+            size_t dep = 0;
+            while (dep < tasks.size() && tasks[dep].name != name) ++dep;
+            if (dep == tasks.size()) {
+                AIOTEK_LOG_ERROR("ManagersTask: Task " + tasks[index].name + " depends on unknown task " + name);
+                return false;
+            }
+            dependencies[index].push_back(dep);
+            dependents[dep].push_back(index);
+            ++pending[index];
+        }
+    }
+
+    // Kahn's algorithm; ties keep registration order.
+    startOrder.clear();
+    std::vector<bool> ordered(tasks.size(), false);
+    while (startOrder.size() < tasks.size()) {
+        size_t next = 0;
+        while (next < tasks.size() && (ordered[next] || pending[next] != 0)) ++next;
+        if (next == tasks.size()) {
+            std::string cycle;
+            for (size_t index = 0; index < tasks.size(); ++index) {
+                if (!ordered[index]) cycle += (cycle.empty() ? "" : ", ") + tasks[index].name;
+            }
+            AIOTEK_LOG_ERROR("ManagersTask: Dependency cycle between " + cycle);
+            return false;
+        }
+        ordered[next] = true;
+        startOrder.push_back(next);
+        for (size_t dependent : dependents[next]) --pending[dependent];
+    }
+    return true;
+}
+
+// Every mailbox is configured here, before any task starts: configure() is
+// not thread-safe once producers can reach the mailbox, and with parallel
+// and on-demand starts a task's own start() is already too late. Called
+// from start(), not the constructor: `managers` is a global, and
+// g_mailboxes lives in another translation unit that may not have been
+// constructed yet when it is.
+void ManagersTask::configureMailboxes() {
+    // MQTTTask waits on its mailbox and the broker socket in one epoll_wait.
+    MailboxConfig mqttMailbox;
+    mqttMailbox.eventfd = true;
+    g_mailboxes.configure(TaskID::MQTT, mqttMailbox);
+
+    MailboxConfig receiverMailbox;
+    receiverMailbox.capacity = 256;
+    receiverMailbox.overflow = MailboxOverflow::Block;
+    receiverMailbox.blockTimeout = std::chrono::milliseconds(100);
+    // A scripted console or a replay must not crowd out other senders.
+    receiverMailbox.fairness = MailboxFairness::RoundRobin;
+    receiverMailbox.senderLimits[static_cast<size_t>(TaskID::Sender)] = {100, 100};
+    g_mailboxes.configure(TaskID::Receiver, receiverMailbox);
+
+    // Read back what the mailbox applied: the Ring backend, for one, drops
+    // fairness and rate limits.
+    const MailboxConfig& applied = g_mailboxes.get(TaskID::Receiver).config();
+    const MailboxRateLimit& limit = applied.senderLimits[static_cast<size_t>(TaskID::Sender)];
+    AIOTEK_LOG_INFO(std::string("ManagersTask: Receiver mailbox ") +
+                    (applied.fairness == MailboxFairness::RoundRobin ? "round-robin" : "fifo") +
+                    ", Sender limited to " + std::to_string(limit.rate) + "/s burst " + std::to_string(limit.burst));
 }
 
 bool ManagersTask::start() {
+    std::unique_lock<std::mutex> lock(activateMutex);
     if (running) return true;
+    if (!resolveDependencies()) return false;
     AIOTEK_LOG_INFO("ManagersTask: Starting");
+    auto begin = std::chrono::steady_clock::now();
+    configureMailboxes();
+    // Left set by the last stop (the Receiver sets it on SignalEvent 0);
+    // the function tasks would exit again straight away.
+    g_shutdown_requested = false;
     running = true;
-    for (auto& task : tasks) {
-        task.thread = std::thread(task.func);
-        AIOTEK_LOG_INFO("ManagersTask: Started task " + task.name);
+    g_scheduler.start();
+    // Arm the lazy tasks first, so eager ones can use them right away.
+    for (size_t index = 0; index < tasks.size(); ++index) {
+        if (tasks[index].activation == TaskActivation::Lazy) {
+            g_mailboxes.on_demand(tasks[index].mailbox, [this, index]() {
+                std::unique_lock<std::mutex> lock(activateMutex);
+                activateLocked(index, lock);
+            });
+        }
+    }
+
+    // Device init is mostly waiting, so each eager task starts on its own
+    // thread once its dependencies are up; independent ones overlap. The
+    // lock is released meanwhile: a task that sends to a lazy one while it
+    // starts activates it, which takes the lock.
+    lock.unlock();
+    std::vector<std::promise<bool>> ready(tasks.size());
+    std::vector<std::shared_future<bool>> up;
+    for (auto& promise : ready) up.push_back(promise.get_future().share());
+    std::vector<std::thread> starters;
+    for (size_t index : startOrder) {
+        if (tasks[index].activation == TaskActivation::Lazy) {
+            ready[index].set_value(true);
+            continue;
+        }
+        starters.emplace_back([this, index, &ready, &up]() {
+            bool dependenciesUp = true;
+            for (size_t dep : dependencies[index]) {
+                dependenciesUp = up[dep].get() && dependenciesUp;
+            }
+            if (!dependenciesUp) {
+                AIOTEK_LOG_ERROR("ManagersTask: Not starting task " + tasks[index].name + ": a dependency failed");
+            }
+            std::unique_lock<std::mutex> lock(activateMutex);
+            ready[index].set_value(dependenciesUp && running && startLocked(tasks[index], lock));
+        });
     }
+    for (auto& starter : starters) {
+        starter.join();
+    }
+    lock.lock();
+    // stop() may have run while the tasks were starting.
+    if (!running) return false;
+    AIOTEK_LOG_INFO("ManagersTask: Started in " + std::to_string(millisecondsSince(begin)) + " ms");
     taskThread = std::thread(&ManagersTask::run, this);
     return true;
 }
 
+bool ManagersTask::activate(TaskID mailbox) {
+    std::unique_lock<std::mutex> lock(activateMutex);
+    for (size_t index = 0; index < tasks.size(); ++index) {
+        if (tasks[index].mailbox == mailbox && mailbox != TaskID::Unknown) {
+            return activateLocked(index, lock);
+        }
+    }
+    return false;
+}
+
+bool ManagersTask::activateLocked(size_t index, std::unique_lock<std::mutex>& lock) {
+    if (!running) return false;
+    for (size_t dep : dependencies[index]) {
+        if (!activateLocked(dep, lock)) {
+            AIOTEK_LOG_ERROR("ManagersTask: Not starting task " + tasks[index].name + ": " + tasks[dep].name + " is not running");
+            return false;
+        }
+    }
+    return startLocked(tasks[index], lock);
+}
+
+// Called with the lock held; releases it around ITask::start() so other
+// tasks start in parallel. Another caller for the same entry waits here.
+bool ManagersTask::startLocked(TaskEntry& entry, std::unique_lock<std::mutex>& lock) {
+    startedCond.wait(lock, [&entry]() { return !entry.starting; });
+    TaskHealth health = entry.task->health();
+    if (health == TaskHealth::Running || health == TaskHealth::Degraded) return true;
+    if (health == TaskHealth::Failed) return false;
+    if (entry.stopper.joinable()) {
+        if (entry.stopped.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            AIOTEK_LOG_ERROR("ManagersTask: Not starting task " + entry.name + ": it is still stopping");
+            return false;
+        }
+        entry.stopper.join();
+    }
+    if (entry.activation == TaskActivation::Lazy) {
+        g_mailboxes.on_demand(entry.mailbox, nullptr);
+    }
+    // stopTask() closed the mailbox, and so may the task itself on the
+    // way out (task_receiver does): a restart must not start at end of stream.
+    if (entry.mailbox != TaskID::Unknown) {
+        g_mailboxes.get(entry.mailbox).reopen();
+    }
+    auto begin = std::chrono::steady_clock::now();
+    entry.started = true;
+    entry.starting = true;
+    lock.unlock();
+    bool ok = entry.task->start(entry.sched);
+    lock.lock();
+    entry.starting = false;
+    startedCond.notify_all();
+    if (!ok) {
+        AIOTEK_LOG_ERROR("ManagersTask: Failed to start task " + entry.name);
+        return false;
+    }
+    AIOTEK_LOG_INFO("ManagersTask: Started task " + entry.name + " in " + std::to_string(millisecondsSince(begin)) + " ms");
+    return true;
+}
+
 void ManagersTask::stop() {
-    if (!running) return;
-    AIOTEK_LOG_INFO("ManagersTask: Stopping");
-    running = false;
-    for (auto& task : tasks) {
-        if (task.thread.joinable()) {
-            task.thread.join();
-            AIOTEK_LOG_INFO("ManagersTask: Stopped task " + task.name);
+    {
+        std::unique_lock<std::mutex> lock(activateMutex);
+        if (!running) return;
+        AIOTEK_LOG_INFO("ManagersTask: Stopping");
+        running = false;
+        // No new start begins now; let the ones under way finish.
+        startedCond.wait(lock, [this]() {
+            return std::none_of(tasks.begin(), tasks.end(), [](const TaskEntry& entry) { return entry.starting; });
+        });
+    }
+    for (auto& entry : tasks) {
+        if (entry.activation == TaskActivation::Lazy) {
+            g_mailboxes.on_demand(entry.mailbox, nullptr);
         }
     }
+    g_scheduler.stop();
+
+    // Dependents first, so no task loses something it uses while running.
+    for (auto it = startOrder.rbegin(); it != startOrder.rend(); ++it) {
+        stopTask(tasks[*it]);
+    }
+    g_mailboxes.close_all();
     if (taskThread.joinable()) {
         taskThread.join();
     }
 }
 
+void ManagersTask::stopTask(TaskEntry& entry) {
+    if (!entry.started || !entry.task) return;
+    auto deadline = std::chrono::steady_clock::now() + entry.stopTimeout;
+    auto remaining = [&deadline]() {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return std::max(left, std::chrono::milliseconds(0));
+    };
+
+    // Let a mailbox-driven task see the shutdown signal and finish what it
+    // is handling before its mailbox closes under it.
+    TaskHealth health = entry.task->health();
+    if (entry.mailbox != TaskID::Unknown && (health == TaskHealth::Running || health == TaskHealth::Degraded)) {
+        auto ticket = g_acks.broadcast(TaskID::Managers, TaskSet{entry.mailbox}, SignalEvent{0});
+        g_acks.wait(ticket, remaining());
+    }
+    if (entry.mailbox != TaskID::Unknown) {
+        g_mailboxes.get(entry.mailbox).close();
+    }
+
+    // ITask::stop() joins the task thread, which may be stuck (the console
+    // blocks on stdin), so it runs aside and is waited for with the budget.
+    // The entry keeps both the task and that thread; see stuckTasks().
+    if (entry.stopper.joinable()) return; // still stopping from last time
+    ITask* task = entry.task.get();
+    std::promise<void> done;
+    entry.stopped = done.get_future();
+    entry.stopper = std::thread([task](std::promise<void> done) {
+        task->stop();
+        done.set_value();
+    }, std::move(done));
+    if (entry.stopped.wait_until(deadline) == std::future_status::timeout) {
+        AIOTEK_LOG_WARNING("ManagersTask: Task " + entry.name + " did not stop within " +
+                           std::to_string(entry.stopTimeout.count()) + " ms, still stopping");
+        return;
+    }
+    entry.stopper.join();
+    AIOTEK_LOG_INFO("ManagersTask: Stopped task " + entry.name);
+}
+
+nlohmann::json ManagersTask::stats() const {
+    nlohmann::json json;
+    for (const auto& entry : tasks) {
+        if (entry.task) {
+            json[entry.name] = TaskStatsToJson(entry.task->stats());
+        }
+    }
+    return json;
+}
+
+std::vector<std::string> ManagersTask::stuckTasks() const {
+    std::vector<std::string> stuck;
+    for (const auto& entry : tasks) {
+        if (entry.stopper.joinable() && entry.stopped.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            stuck.push_back(entry.name);
+        }
+    }
+    return stuck;
+}
+
 bool ManagersTask::isRunning() const {
     return running;
 }
@@ -3,17 +3,49 @@
 
 #include <vector>
 #include <thread>
-#include <functional>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <nlohmann/json.hpp>
 #include "aiotek_log.hpp"
 #include "aiotek_timer.hpp"
+#include "aiotek_task_thread.hpp"
+#include "aiotek_mailbox.hpp"
+#include "aiotek_task.hpp"
 
 namespace AIOTEK {
 
+enum class TaskActivation {
+    Eager, // started by ManagersTask::start()
+    Lazy,  // started by the first message sent to its mailbox
+};
+
+// One row of the task table: the task, and how its thread is placed and
+// scheduled (see TaskThreadConfig).
 struct TaskEntry {
     std::string name;
-    std::function<void()> func;
-    std::thread thread = std::thread();
+    std::unique_ptr<ITask> task;
+    // Mailbox the task drains. It gets the shutdown broadcast in stop() and
+    // must ack it; Unknown for tasks that do not read a mailbox.
+    TaskID mailbox = TaskID::Unknown;
+    TaskThreadConfig sched = TaskThreadConfig();
+    // Lazy needs a mailbox: a pipeline task holds no device and no thread
+    // until a consumer sends it a request.
+    TaskActivation activation = TaskActivation::Eager;
+    // Names of the tasks this one uses. It starts after them (a Lazy one
+    // counts as started once armed) and stops before them.
+    std::vector<std::string> dependsOn = {};
+    // Budget for the shutdown ack plus ITask::stop(). A task that overruns
+    // it is left stopping so the rest of the shutdown can proceed.
+    std::chrono::milliseconds stopTimeout = std::chrono::milliseconds(1000);
+    bool started = false;  // set by ManagersTask once it has called start()
+    bool starting = false; // inside ITask::start(), called without the lock
+    // Runs ITask::stop(); still joinable while a task overruns stopTimeout.
+    std::thread stopper = std::thread();
+    std::future<void> stopped = std::future<void>();
 };
 
 class ManagersTask {
@@ -22,17 +54,39 @@ private:
     std::thread taskThread;
     Timer timer;
     std::vector<TaskEntry> tasks;
+    std::vector<std::vector<size_t>> dependencies; // tasks index -> dependsOn indices
+    std::vector<size_t> startOrder;                // topological: dependencies first
+    std::mutex activateMutex; // start()/stop() against on-demand activation
+    std::condition_variable startedCond; // a TaskEntry::starting went false
 
 public:
     ManagersTask();
     ~ManagersTask();
+    // Starts the Eager tasks, each on its own thread as soon as its
+    // dependencies have started. False if dependsOn names an unknown task
+    // or forms a cycle.
     bool start();
+    // Stops the tasks in reverse dependency order.
     void stop();
     bool isRunning() const;
+    // Starts the task draining mailbox if it is not running yet; what a
+    // Lazy task's first message does. False if it is unknown or failed.
+    bool activate(TaskID mailbox);
+    // Health and counters of every task, by name.
+    nlohmann::json stats() const;
+    // Tasks whose ITask::stop() overran stopTimeout and is still running.
+    // The destructor waits for them; a process that cannot wait (the
+    // console blocks on stdin) should leave with std::quick_exit().
+    std::vector<std::string> stuckTasks() const;
 
 private:
     void run();
     void processManagers();
+    void configureMailboxes();
+    bool resolveDependencies();
+    bool activateLocked(size_t index, std::unique_lock<std::mutex>& lock);
+    bool startLocked(TaskEntry& entry, std::unique_lock<std::mutex>& lock);
+    void stopTask(TaskEntry& entry);
 };
 
 extern ManagersTask managers;
@@ -4,27 +4,39 @@
 #include "utils/aiotek_log.hpp"
 #include "common/aiotek_timer.hpp"
 #include "module/network/mqtt/aiotek_mqtt.hpp"
+#include "core/aiotek_mailbox.hpp"
+#include "core/aiotek_mailbox_ack.hpp"
+#include "core/aiotek_mailbox_rpc.hpp"
+#include "core/aiotek_mailbox_scheduler.hpp"
+#include "core/aiotek_mailbox_stats.hpp"
+#include "core/aiotek_poller.hpp"
+#include "app/aiotek_task.hpp"
+#include "app/aiotek_managers_task.hpp"
 
 namespace AIOTEK {
 
-class MQTTTask {
+class MQTTTask : public ITask {
 private:
     bool running;
-    std::thread taskThread;
+    TaskThread taskThread;
     Timer timer;
     MQTTManager mqttManager;
+    MailboxTimerId statusTimer = 0;
+    TaskState state;
 
 public:
     MQTTTask() : running(false) {}
     
-    ~MQTTTask() {
+    ~MQTTTask() override {
         stop();
     }
     
-    bool start() {
+    bool start(const TaskThreadConfig& sched) override {
         if (running) return true;
         
         AIOTEK_LOG_INFO("MQTTTask: Starting");
+        // stop() closed the mailbox; a restarted task receives again.
+        g_mailboxes.get(TaskID::MQTT).reopen();
         
         MQTTManager::MQTTConfig config;
         config.broker = "broker.hivemq.com";
@@ -35,42 +47,60 @@ public:
         
         mqttManager.setConfig(config);
         
-        mqttManager.onConnect([]() {
+        mqttManager.onConnect([this]() {
             AIOTEK_LOG_INFO("MQTTTask: Connected to broker");
+            state.setRunning();
         });
         
-        mqttManager.onDisconnect([]() {
+        mqttManager.onDisconnect([this]() {
             AIOTEK_LOG_INFO("MQTTTask: Disconnected from broker");
+            state.setDegraded();
         });
         
-        mqttManager.onError([](const std::string& error) {
+        mqttManager.onError([this](const std::string& error) {
             AIOTEK_LOG_ERROR("MQTTTask: Error: " + error);
+            state.addError();
         });
         
         mqttManager.onMessage([](const std::string& topic, const std::string& payload) {
             AIOTEK_LOG_INFO("MQTTTask: Received message on " + topic + ": " + payload);
+            // Hand commands to the task thread; the client callback must not block.
+            if (topic == "icamera/command") {
+                g_mailboxes.emplace(TaskID::MQTT, TaskID::MQTT, CustomEvent{"mqtt.command", payload});
+            }
         });
         
         running = true;
-        taskThread = std::thread(&MQTTTask::run, this);
+        state.setRunning();
+        if (!taskThread.start("MQTT", sched, [this]() { run(); })) {
+            running = false;
+            state.setFailed();
+            return false;
+        }
         return true;
     }
     
-    void stop() {
+    void stop() override {
         if (!running) return;
         
         AIOTEK_LOG_INFO("MQTTTask: Stopping");
         running = false;
+        g_mailboxes.get(TaskID::MQTT).close();
         
-        if (taskThread.joinable()) {
-            taskThread.join();
-        }
+        taskThread.join();
         
         mqttManager.disconnect();
+        if (state.health() != TaskHealth::Failed) {
+            state.setStopped();
+        }
     }
     
-    bool isRunning() const {
-        return running;
+    TaskHealth health() const override {
+        return state.health();
+    }
+    
+    TaskStats stats() const override {
+        return state.stats();
     }
 
 private:
@@ -80,23 +110,94 @@ private:
         
         if (mqttManager.connect() != 0) {
             AIOTEK_LOG_ERROR("MQTTTask: Failed to connect to MQTT broker");
+            state.setFailed();
             return;
         }
 
         mqttManager.subscribe("icamera/command");
         mqttManager.subscribe("icamera/config");
         
+        // One epoll_wait on the mailbox: wakes for messages, for stop()
+        // (which closes the mailbox) and for the status timer.
+        Mailbox& mailbox = g_mailboxes.get(TaskID::MQTT);
+        EventPoller poller;
+        poller.add(mailbox.readiness_fd(), 0);
+        std::vector<epoll_event> ready;
+        std::vector<MailboxEnvelope> batch;
+        MailboxEnvelope statusTick(TaskID::MQTT, TaskID::MQTT, CustomEvent{"mqtt.status", ""});
+        // A tick still queued when the next one is due is stale.
+        statusTick.expire_after(std::chrono::seconds(5));
+        statusTimer = g_scheduler.send_every(std::chrono::seconds(5), std::chrono::milliseconds(0), statusTick);
+        
         while (running) {
-            sendStatusUpdate();
-            std::this_thread::sleep_for(std::chrono::seconds(5));
+            poller.wait(ready, std::chrono::milliseconds(-1));
+            mailbox.clear_readiness();
+            batch.clear();
+            mailbox.drain(batch);
+            for (const auto& env : batch) {
+                handleMessage(env);
+            }
         }
         
+        g_scheduler.cancel(statusTimer);
         mqttManager.disconnect();
         
         timer.stop();
         AIOTEK_LOG_INFO("MQTTTask: Thread stopped after " + timer.getElapsedString());
     }
     
+    void handleMessage(const MailboxEnvelope& env) {
+        static const EventName kCommand("mqtt.command");
+        static const EventName kStatus("mqtt.status");
+        state.addProcessed();
+        const auto* signal = std::get_if<SignalEvent>(&env.payload);
+        if (signal && signal->signal == 0) {
+            g_acks.ack(env);
+            return;
+        }
+        const auto* event = std::get_if<CustomEvent>(&env.payload);
+        if (event && event->name == kCommand) {
+            handleCommand(event->payload);
+            return;
+        }
+        if (event && event->name == kStatus) {
+            sendStatusUpdate();
+            return;
+        }
+        AIOTEK_LOG_DEBUG(std::string("MQTTTask: Message from ") + TaskIDToString(env.sender));
+    }
+    
+    void handleCommand(const std::string& command) {
+        nlohmann::json response;
+        response["command"] = command;
+        if (command == "snapshot") {
+            const auto timeout = std::chrono::milliseconds(500);
+            auto start = std::chrono::steady_clock::now();
+            auto reply = g_rpc.call(TaskID::MQTT, TaskID::Video, CustomEvent{"video.snapshot", ""}, timeout);
+            try {
+                MailboxMessage result = reply.get();
+                if (const auto* frame = std::get_if<BufferEvent>(&result)) {
+                    response["status"] = "ok";
+                    response["width"] = frame->buffer.info().width;
+                    response["height"] = frame->buffer.info().height;
+                    response["format"] = BufferFormatToString(frame->buffer.info().format);
+                    response["bytes"] = frame->buffer.size();
+                } else if (const auto* error = std::get_if<ErrorEvent>(&result)) {
+                    response["status"] = "error";
+                    response["error"] = error->message;
+                }
+            } catch (const MailboxRpcError& e) {
+                response["status"] = "error";
+                response["error"] = e.what();
+            }
+            response["latency_us"] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        } else {
+            response["status"] = "error";
+            response["error"] = "unknown command";
+        }
+        mqttManager.publish("icamera/response", response);
+    }
+    
     void sendStatusUpdate() {
         static int counter = 0;
         nlohmann::json status;
@@ -105,14 +206,21 @@ private:
         status["uptime"] = timer.getElapsedSeconds();
         status["counter"] = ++counter;
         status["status"] = "running";
+        status["mailbox"] = MailboxStatsToJson(CollectMailboxStats());
+        status["tasks"] = managers.stats();
         
         std::string topic = "icamera/status";
         if (mqttManager.publish(topic, status) == 0) {
             AIOTEK_LOG_DEBUG("MQTTTask: Sent status update");
         } else {
             AIOTEK_LOG_ERROR("MQTTTask: Failed to send status update");
+            state.addError();
         }
     }
 };
 
+std::unique_ptr<ITask> MakeMQTTTask() {
+    return std::make_unique<MQTTTask>();
+}
+
 } // namespace AIOTEK
@@ -0,0 +1,117 @@
+#include <chrono>
+#include "aiotek_log.hpp"
+#include "aiotek_task.hpp"
+
+namespace AIOTEK {
+
+static int64_t steadyMilliseconds() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TaskState::setRunning() {
+    // Coming back from Degraded continues the same run.
+    TaskHealth previous = health_.exchange(TaskHealth::Running);
+    if (previous != TaskHealth::Running && previous != TaskHealth::Degraded) {
+        since_.store(steadyMilliseconds());
+    }
+}
+
+void TaskState::setDegraded() {
+    TaskHealth expected = TaskHealth::Running;
+    health_.compare_exchange_strong(expected, TaskHealth::Degraded);
+}
+
+void TaskState::setStopped() {
+    health_.store(TaskHealth::Stopped);
+}
+
+void TaskState::setFailed() {
+    health_.store(TaskHealth::Failed);
+}
+
+void TaskState::addProcessed(uint64_t count) {
+    processed_.fetch_add(count, std::memory_order_relaxed);
+}
+
+void TaskState::addError() {
+    errors_.fetch_add(1, std::memory_order_relaxed);
+}
+
+TaskHealth TaskState::health() const {
+    return health_.load();
+}
+
+TaskStats TaskState::stats() const {
+    TaskStats stats;
+    stats.health = health_.load();
+    if (stats.health == TaskHealth::Running || stats.health == TaskHealth::Degraded) {
+        stats.uptime = (steadyMilliseconds() - since_.load()) / 1000.0;
+    }
+    stats.processed = processed_.load(std::memory_order_relaxed);
+    stats.errors = errors_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+nlohmann::json TaskStatsToJson(const TaskStats& stats) {
+    nlohmann::json json;
+    json["health"] = TaskHealthToString(stats.health);
+    json["uptime"] = stats.uptime;
+    json["processed"] = stats.processed;
+    json["errors"] = stats.errors;
+    return json;
+}
+
+namespace {
+
+class FunctionTask : public ITask {
+private:
+    std::string name;
+    std::function<void()> func;
+    TaskThread taskThread;
+    TaskState state;
+
+public:
+    FunctionTask(const std::string& name, std::function<void()> func) : name(name), func(std::move(func)) {}
+
+    ~FunctionTask() override {
+        stop();
+    }
+
+    bool start(const TaskThreadConfig& sched) override {
+        if (taskThread.joinable()) {
+            if (state.health() == TaskHealth::Running) return true;
+            // func already returned: reap its thread and run it again.
+            taskThread.join();
+        }
+        state.setRunning();
+        bool started = taskThread.start(name, sched, [this]() {
+            func();
+            state.setStopped();
+        });
+        if (!started) {
+            state.setFailed();
+        }
+        return started;
+    }
+
+    void stop() override {
+        taskThread.join();
+    }
+
+    TaskHealth health() const override {
+        return state.health();
+    }
+
+    TaskStats stats() const override {
+        return state.stats();
+    }
+};
+
+} // namespace
+
+std::unique_ptr<ITask> MakeFunctionTask(const std::string& name, std::function<void()> func) {
+    return std::make_unique<FunctionTask>(name, std::move(func));
+}
+
+} // namespace AIOTEK
@@ -0,0 +1,84 @@
+#ifndef AIOTEK_TASK_HPP
+#define AIOTEK_TASK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <nlohmann/json.hpp>
+#include "aiotek_task_thread.hpp"
+
+namespace AIOTEK {
+
+enum class TaskHealth : uint8_t {
+    Stopped,  // not started, or stopped
+    Running,
+    Degraded, // running without something it needs (e.g. the MQTT broker)
+    Failed,   // could not start, or its thread gave up
+};
+
+inline const char* TaskHealthToString(TaskHealth health) {
+    switch (health) {
+        case TaskHealth::Stopped: return "stopped";
+        case TaskHealth::Running: return "running";
+        case TaskHealth::Degraded: return "degraded";
+        case TaskHealth::Failed: return "failed";
+    }
+    return "unknown";
+}
+
+struct TaskStats {
+    TaskHealth health = TaskHealth::Stopped;
+    double uptime = 0.0;    // seconds since the task last started running
+    uint64_t processed = 0; // units of work: audio chunks, frames, messages
+    uint64_t errors = 0;
+};
+
+// Lifecycle every task run by ManagersTask implements. start() acquires the
+// task's devices and starts its thread; stop() ends the thread and releases
+// them, and must be safe to call on a task that never started.
+class ITask {
+public:
+    virtual ~ITask() = default;
+    // False if the task could not start; health() then reports Failed.
+    virtual bool start(const TaskThreadConfig& sched) = 0;
+    virtual void stop() = 0;
+    virtual TaskHealth health() const = 0;
+    virtual TaskStats stats() const = 0;
+};
+
+// Health and counters a task updates from its own thread while health()
+// and stats() read them from any other.
+class TaskState {
+public:
+    void setRunning();
+    void setDegraded();
+    void setStopped();
+    void setFailed();
+    void addProcessed(uint64_t count = 1);
+    void addError();
+
+    TaskHealth health() const;
+    TaskStats stats() const;
+
+private:
+    std::atomic<TaskHealth> health_{TaskHealth::Stopped};
+    std::atomic<int64_t> since_{0}; // steady clock, ms, when setRunning() ran
+    std::atomic<uint64_t> processed_{0};
+    std::atomic<uint64_t> errors_{0};
+};
+
+nlohmann::json TaskStatsToJson(const TaskStats& stats);
+
+// Runs func on a TaskThread named name; Running until func returns, after
+// which start() runs it again. A func that closes its mailbox on the way
+// out relies on ManagersTask to reopen it before the restart.
+std::unique_ptr<ITask> MakeFunctionTask(const std::string& name, std::function<void()> func);
+std::unique_ptr<ITask> MakeAudioTask();
+std::unique_ptr<ITask> MakeVideoTask();
+std::unique_ptr<ITask> MakeMQTTTask();
+
+} // namespace AIOTEK
+
+#endif // AIOTEK_TASK_HPP
@@ -1,30 +1,41 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <memory>
+#include <vector>
 #include "utils/aiotek_log.hpp"
 #include "common/aiotek_timer.hpp"
 #include "module/video/aiotek_video.hpp"
+#include "core/aiotek_mailbox.hpp"
+#include "core/aiotek_mailbox_ack.hpp"
+#include "core/aiotek_mailbox_rpc.hpp"
+#include "app/aiotek_task.hpp"
 
 namespace AIOTEK {
 
-class VideoTask {
+class VideoTask : public ITask {
 private:
     bool running;
-    std::thread taskThread;
+    TaskThread taskThread;
     Timer timer;
     VideoManager videoManager;
+    std::unique_ptr<BufferPool> snapshotPool;
+    VideoFrame lastFrame;
+    TaskState state;
 
 public:
     VideoTask() : running(false) {}
     
-    ~VideoTask() {
+    ~VideoTask() override {
         stop();
     }
     
-    bool start() {
+    bool start(const TaskThreadConfig& sched) override {
         if (running) return true;
         
         AIOTEK_LOG_INFO("VideoTask: Starting");
+        // stop() closed the mailbox; a restarted task receives again.
+        g_mailboxes.get(TaskID::Video).reopen();
         
         VideoConfig config;
         config.width = 640;
@@ -33,33 +44,49 @@ public:
         
         if (!videoManager.initialize(config)) {
             AIOTEK_LOG_ERROR("VideoTask: Failed to initialize video manager");
+            state.setFailed();
             return false;
         }
         
+        // Two blocks: one snapshot in flight to a caller, one being filled.
+        snapshotPool.reset(new BufferPool(static_cast<size_t>(config.width) * config.height * 2, 2));
+        
         videoManager.setFrameCallback([this](const VideoFrame& frame) {
             this->onFrameReceived(frame);
         });
         
         running = true;
-        taskThread = std::thread(&VideoTask::run, this);
+        state.setRunning();
+        if (!taskThread.start("Video", sched, [this]() { run(); })) {
+            running = false;
+            state.setFailed();
+            videoManager.shutdown();
+            return false;
+        }
         return true;
     }
     
-    void stop() {
+    void stop() override {
         if (!running) return;
         
         AIOTEK_LOG_INFO("VideoTask: Stopping");
         running = false;
+        g_mailboxes.get(TaskID::Video).close();
         
-        if (taskThread.joinable()) {
-            taskThread.join();
-        }
+        taskThread.join();
         
         videoManager.shutdown();
+        if (state.health() != TaskHealth::Failed) {
+            state.setStopped();
+        }
     }
     
-    bool isRunning() const {
-        return running;
+    TaskHealth health() const override {
+        return state.health();
+    }
+    
+    TaskStats stats() const override {
+        return state.stats();
     }
 
 private:
@@ -69,13 +96,28 @@ private:
 
         if (!videoManager.startCapture()) {
             AIOTEK_LOG_ERROR("VideoTask: Failed to start video capture");
+            state.setFailed();
             return;
         }
         
-        while (running) {
-
-            processVideo();
-            std::this_thread::sleep_for(std::chrono::milliseconds(33));
+        // The frame period doubles as the mailbox wait, so requests such as
+        // snapshots are answered within the current frame.
+        Mailbox& mailbox = g_mailboxes.get(TaskID::Video);
+        std::vector<MailboxEnvelope> batch;
+        auto nextFrame = std::chrono::steady_clock::now();
+        // A closed mailbox means shutdown: receive would no longer wait, and
+        // at SCHED_FIFO this loop would starve every other thread.
+        while (running && !mailbox.closed()) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= nextFrame) {
+                processVideo();
+                nextFrame = now + std::chrono::milliseconds(33);
+            }
+            batch.clear();
+            mailbox.receive_batch_for(batch, 8, std::chrono::duration_cast<std::chrono::milliseconds>(nextFrame - now));
+            for (const auto& env : batch) {
+                handleMessage(env);
+            }
         }
         
         videoManager.stopCapture();
@@ -86,11 +128,48 @@ private:
     
     void processVideo() {
         if (videoManager.hasFrame()) {
-            VideoFrame frame = videoManager.getFrame();
-            videoManager.processFrame(frame);
+            lastFrame = videoManager.getFrame();
+            videoManager.processFrame(lastFrame);
+            state.addProcessed();
+        }
+    }
+    
+    void handleMessage(const MailboxEnvelope& env) {
+        static const EventName kSnapshot("video.snapshot");
+        const auto* signal = std::get_if<SignalEvent>(&env.payload);
+        if (signal && signal->signal == 0) {
+            g_acks.ack(env);
+            return;
+        }
+        const auto* event = std::get_if<CustomEvent>(&env.payload);
+        if (event && event->name == kSnapshot) {
+            g_rpc.reply(env, takeSnapshot());
+            return;
+        }
+        if (env.flags & kEnvelopeRequest) {
+            g_rpc.reply(env, ErrorEvent{-1, "VideoTask: unsupported request"});
         }
     }
     
+    MailboxMessage takeSnapshot() {
+        if (lastFrame.data.empty()) {
+            return ErrorEvent{-1, "VideoTask: no frame captured yet"};
+        }
+        MutableBuffer buffer = snapshotPool->acquire();
+        if (!buffer || buffer.capacity() < lastFrame.data.size()) {
+            state.addError();
+            return ErrorEvent{-2, "VideoTask: snapshot buffers busy"};
+        }
+        std::copy(lastFrame.data.begin(), lastFrame.data.end(), buffer.data());
+        buffer.setSize(lastFrame.data.size());
+        buffer.info().format = BufferFormat::YUYV;
+        buffer.info().width = static_cast<uint32_t>(lastFrame.width);
+        buffer.info().height = static_cast<uint32_t>(lastFrame.height);
+        buffer.info().stride = static_cast<uint32_t>(lastFrame.width * lastFrame.channels);
+        buffer.info().timestamp = lastFrame.timestamp * 1000;
+        return BufferEvent{std::move(buffer).publish()};
+    }
+    
     void onFrameReceived(const VideoFrame& frame) {
         static int frameCounter = 0;
         if (++frameCounter % 30 == 0) {
@@ -100,4 +179,8 @@ private:
     }
 };
 
+std::unique_ptr<ITask> MakeVideoTask() {
+    return std::make_unique<VideoTask>();
+}
+
 } // namespace AIOTEK
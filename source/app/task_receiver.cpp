@@ -1,33 +1,96 @@
-#include <iostream>
+#include <string>
+#include <vector>
 #include "aiotek_mailbox.hpp"
+#include "aiotek_mailbox_ack.hpp"
+#include "aiotek_mailbox_dispatch.hpp"
+#include "aiotek_event_bus.hpp"
 #include "aiotek_managers_task.hpp"
+#include "aiotek_log.hpp"
+
+using AIOTEK::MailboxEnvelope;
+
+static constexpr size_t kReceiveBatch = 32;
+
+static std::string from(const MailboxEnvelope& env) {
+    return std::string("[Receiver] ") + AIOTEK::TaskIDToString(env.sender) + " -> " + AIOTEK::TaskIDToString(env.receiver) + ": ";
+}
+
+struct OnSignal {
+    void operator()(const MailboxEnvelope& env, const AIOTEK::SignalEvent& event) const {
+        AIOTEK_LOG_INFO(from(env) + "SignalEvent " + std::to_string(event.signal));
+        if (event.signal == 0) {
+            AIOTEK_LOG_INFO("[Receiver] Shutdown signal received. Exiting...");
+            AIOTEK::g_shutdown_requested = true;
+        }
+    }
+};
+
+struct OnEvent {
+    void operator()(const MailboxEnvelope& env, const AIOTEK::CustomEvent& event) const {
+        AIOTEK_LOG_INFO(from(env) + "CustomEvent " + event.name + " | " + event.payload);
+    }
+    void operator()(const MailboxEnvelope& env, const AIOTEK::SharedEvent& event) const {
+        if (!event.event) {
+            AIOTEK_LOG_WARNING(from(env) + "SharedEvent without an event");
+            return;
+        }
+        AIOTEK_LOG_INFO(from(env) + "SharedEvent " + event.event->name + " | " + event.event->payload);
+    }
+    void operator()(const MailboxEnvelope& env, const AIOTEK::ErrorEvent& event) const {
+        AIOTEK_LOG_INFO(from(env) + "ErrorEvent " + std::to_string(event.code) + " | " + event.message);
+    }
+};
+
+struct OnValue {
+    void operator()(const MailboxEnvelope& env, const std::string& text) const {
+        AIOTEK_LOG_INFO(from(env) + "String " + text);
+    }
+    void operator()(const MailboxEnvelope& env, int value) const {
+        AIOTEK_LOG_INFO(from(env) + "Int " + std::to_string(value));
+    }
+};
+
+struct OnBuffer {
+    void operator()(const MailboxEnvelope& env, const AIOTEK::BufferEvent& event) const {
+        if (!event.buffer) {
+            AIOTEK_LOG_WARNING(from(env) + "BufferEvent without a buffer");
+            return;
+        }
+        const auto& info = event.buffer.info();
+        AIOTEK_LOG_INFO(from(env) + "BufferEvent " + AIOTEK::BufferFormatToString(info.format) + " " +
+                        std::to_string(info.width) + "x" + std::to_string(info.height) + " | " +
+                        std::to_string(event.buffer.size()) + " bytes");
+    }
+};
+
+// Every MailboxMessage type must be covered here, or this fails to compile.
+using ReceiverHandlers = AIOTEK::MailboxHandlers<OnSignal, OnEvent, OnValue, OnBuffer>;
 
 void task_receiver() {
+    auto& mailbox = AIOTEK::g_mailboxes.get(AIOTEK::TaskID::Receiver);
+    AIOTEK::g_eventBus.subscribe_prefix(AIOTEK::TaskID::Receiver, "");
+    ReceiverHandlers handlers;
+    AIOTEK::MailboxDispatcher<ReceiverHandlers> dispatch(handlers);
+    std::vector<MailboxEnvelope> batch;
+    batch.reserve(kReceiveBatch);
     while (true) {
-        auto env = AIOTEK::g_mailbox.receive();
-        std::cout << "[Receiver] From: " << static_cast<int>(env.sender)
-                  << " To: " << static_cast<int>(env.receiver) << std::endl;
-        std::visit([](auto&& arg){
-            using T = std::decay_t<decltype(arg)>;
-            if constexpr (std::is_same_v<T, AIOTEK::SignalEvent>) {
-                std::cout << "[Receiver] SignalEvent: " << arg.signal << std::endl;
-                if (arg.signal == 0) {
-                    std::cout << "[Receiver] Shutdown signal received. Exiting..." << std::endl;
-                    AIOTEK::g_shutdown_requested = true;
-                }
-            } else if constexpr (std::is_same_v<T, AIOTEK::CustomEvent>) {
-                std::cout << "[Receiver] CustomEvent: " << arg.name << " | " << arg.payload << std::endl;
-            } else if constexpr (std::is_same_v<T, AIOTEK::ErrorEvent>) {
-                std::cout << "[Receiver] ErrorEvent: " << arg.code << " | " << arg.message << std::endl;
-            } else if constexpr (std::is_same_v<T, std::string>) {
-                std::cout << "[Receiver] String: " << arg << std::endl;
-            } else if constexpr (std::is_same_v<T, int>) {
-                std::cout << "[Receiver] Int: " << arg << std::endl;
+        batch.clear();
+        if (mailbox.receive_batch(batch, kReceiveBatch) == 0) {
+            // Mailbox closed by ManagersTask::stop()
+            break;
+        }
+        for (const auto& env : batch) {
+            dispatch(env);
+            // Whatever the payload: the sender is waiting on the ticket.
+            if (env.flags & AIOTEK::kEnvelopeAck) {
+                AIOTEK::g_acks.ack(env);
             }
-        }, env.payload);
-        
+        }
+
         if (AIOTEK::g_shutdown_requested) {
             break;
         }
     }
-} 
\ No newline at end of file
+    // Nobody drains it any more: fail further sends (and broadcasts) fast.
+    mailbox.close();
+}
@@ -1,34 +1,65 @@
 #include <string>
 #include <iostream>
 #include "aiotek_mailbox.hpp"
+#include "aiotek_event_bus.hpp"
+#include "aiotek_mailbox_stats.hpp"
+#include "aiotek_mailbox_recorder.hpp"
 #include "aiotek_console.hpp"
 #include "aiotek_managers_task.hpp"
 
 void task_sender() {
+    using AIOTEK::TaskID;
+    // Static: a sender thread may still be inside record() after set_recorder(nullptr).
+    static AIOTEK::MailboxRecorder recorder;
     while (true) {
-        std::string line = aiotek_console_readline("Enter command (msg <text> | signal <num> | event <name> <payload> | quit): ");
+        std::string line = aiotek_console_readline("Enter command (msg <text> | signal <num> | event <name> <payload> | stats | tasks | record <file>|stop | replay <file> [fast] | quit): ");
         if (line == "quit") {
-            AIOTEK::g_mailbox.send({AIOTEK::TaskID::Sender, AIOTEK::TaskID::Receiver, AIOTEK::SignalEvent{0}});
+            AIOTEK::g_mailboxes.emplace(TaskID::Sender, TaskID::Receiver, AIOTEK::SignalEvent{0});
             break;
         }
-        if (line.rfind("msg ", 0) == 0) {
-            AIOTEK::g_mailbox.send({AIOTEK::TaskID::Sender, AIOTEK::TaskID::Receiver, line.substr(4)});
+        if (line == "stats") {
+            std::cout << AIOTEK::MailboxStatsToString(AIOTEK::CollectMailboxStats());
+        } else if (line == "tasks") {
+            std::cout << AIOTEK::managers.stats().dump(2) << std::endl;
+        } else if (line == "record stop") {
+            AIOTEK::g_mailboxes.set_recorder(nullptr);
+            recorder.stop();
+            std::cout << "Recorded " << recorder.records() << " envelopes (" << recorder.bytes() << " bytes)" << std::endl;
+        } else if (line.rfind("record ", 0) == 0) {
+            if (recorder.start(line.substr(7)))
+                AIOTEK::g_mailboxes.set_recorder(&recorder);
+        } else if (line.rfind("replay ", 0) == 0) {
+            std::string path = line.substr(7);
+            auto mode = AIOTEK::MailboxReplayMode::Timed;
+            if (path.size() > 5 && path.compare(path.size() - 5, 5, " fast") == 0) {
+                path.resize(path.size() - 5);
+                mode = AIOTEK::MailboxReplayMode::AsFastAsPossible;
+            }
+            AIOTEK::MailboxReplayer replayer;
+            if (replayer.open(path)) {
+                auto result = replayer.replay(AIOTEK::g_mailboxes, mode);
+                std::cout << "Replayed " << result.replayed << " envelopes in " << result.elapsed.count() << " us ("
+                          << result.failed << " refused, " << result.corrupt << " undecodable)" << std::endl;
+            }
+        } else if (line.rfind("msg ", 0) == 0) {
+            AIOTEK::g_mailboxes.emplace(TaskID::Sender, TaskID::Receiver, line.substr(4));
         } else if (line.rfind("signal ", 0) == 0) {
             int sig = std::stoi(line.substr(7));
-            AIOTEK::g_mailbox.send({AIOTEK::TaskID::Sender, AIOTEK::TaskID::Receiver, AIOTEK::SignalEvent{sig}});
+            AIOTEK::g_mailboxes.emplace(TaskID::Sender, TaskID::Receiver, AIOTEK::SignalEvent{sig});
         } else if (line.rfind("event ", 0) == 0) {
             size_t sp = line.find(' ', 6);
             if (sp != std::string::npos) {
                 std::string name = line.substr(6, sp-6);
                 std::string payload = line.substr(sp+1);
-                AIOTEK::g_mailbox.send({AIOTEK::TaskID::Sender, AIOTEK::TaskID::Receiver, AIOTEK::CustomEvent{name, payload}});
+                AIOTEK::g_eventBus.publish(TaskID::Sender, AIOTEK::CustomEvent{std::move(name), std::move(payload)});
             }
         } else {
-            AIOTEK::g_mailbox.send({AIOTEK::TaskID::Sender, AIOTEK::TaskID::Receiver, AIOTEK::ErrorEvent{-1, "Unknown command: " + line}});
+            AIOTEK::g_mailboxes.emplace(TaskID::Sender, TaskID::Receiver, AIOTEK::ErrorEvent{-1, "Unknown command: " + line});
         }
         
         if (AIOTEK::g_shutdown_requested) {
             break;
         }
     }
-} 
\ No newline at end of file
+    AIOTEK::g_mailboxes.set_recorder(nullptr);
+} 
@@ -0,0 +1,121 @@
+#include "aiotek_task_thread.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits.h>
+#include <memory>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "aiotek_log.hpp"
+
+namespace AIOTEK {
+
+namespace {
+
+struct StartInfo {
+    std::string name;
+    TaskThreadConfig config;
+    std::function<void()> func;
+};
+
+void warn(const std::string& name, const std::string& what, int err) {
+    AIOTEK_LOG_WARNING("TaskThread: " + name + ": " + what + " (" + std::strerror(err) + "), using the default");
+}
+
+void applyAffinity(const StartInfo& info) {
+    if (info.config.cpuAffinity == 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; ++cpu) {
+        if (info.config.cpuAffinity & (uint64_t(1) << cpu)) CPU_SET(cpu, &set);
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) warn(info.name, "cannot set CPU affinity", err);
+}
+
+void applyNice(const StartInfo& info) {
+    if (info.config.nice == 0) return;
+    // Linux applies PRIO_PROCESS with a thread id to that thread only.
+    auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    if (setpriority(PRIO_PROCESS, tid, info.config.nice) != 0) {
+        warn(info.name, "cannot set nice " + std::to_string(info.config.nice), errno);
+    }
+}
+
+void applyScheduling(const StartInfo& info) {
+    if (info.config.policy == TaskPolicy::Fifo) {
+        sched_param param{};
+        param.sched_priority = std::min(std::max(info.config.priority, sched_get_priority_min(SCHED_FIFO)),
+                                        sched_get_priority_max(SCHED_FIFO));
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err == 0) {
+            AIOTEK_LOG_DEBUG("TaskThread: " + info.name + ": SCHED_FIFO priority " + std::to_string(param.sched_priority));
+            return;
+        }
+        warn(info.name, "cannot use SCHED_FIFO", err);
+    }
+    applyNice(info);
+}
+
+void* threadMain(void* arg) {
+    std::unique_ptr<StartInfo> info(static_cast<StartInfo*>(arg));
+    pthread_setname_np(pthread_self(), info->name.substr(0, 15).c_str());
+    applyAffinity(*info);
+    applyScheduling(*info);
+    info->func();
+    return nullptr;
+}
+
+} // namespace
+
+TaskThread::~TaskThread() {
+    join();
+}
+
+TaskThread::TaskThread(TaskThread&& other) noexcept : thread(other.thread), started(other.started) {
+    other.started = false;
+}
+
+TaskThread& TaskThread::operator=(TaskThread&& other) noexcept {
+    if (this != &other) {
+        join();
+        thread = other.thread;
+        started = other.started;
+        other.started = false;
+    }
+    return *this;
+}
+
+bool TaskThread::start(const std::string& name, const TaskThreadConfig& config, std::function<void()> func) {
+    if (started) return false;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (config.stackSize != 0) {
+        int err = pthread_attr_setstacksize(&attr, std::max<size_t>(config.stackSize, PTHREAD_STACK_MIN));
+        if (err != 0) warn(name, "cannot set stack size " + std::to_string(config.stackSize), err);
+    }
+    auto* info = new StartInfo{name, config, std::move(func)};
+    int err = pthread_create(&thread, &attr, threadMain, info);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        delete info;
+        AIOTEK_LOG_ERROR("TaskThread: " + name + ": pthread_create failed (" + std::strerror(err) + ")");
+        return false;
+    }
+    started = true;
+    return true;
+}
+
+bool TaskThread::joinable() const {
+    return started;
+}
+
+void TaskThread::join() {
+    if (!started) return;
+    pthread_join(thread, nullptr);
+    started = false;
+}
+
+} // namespace AIOTEK
@@ -0,0 +1,51 @@
+#ifndef __AIOTEK_TASK_THREAD_HPP__
+#define __AIOTEK_TASK_THREAD_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <pthread.h>
+
+namespace AIOTEK {
+
+enum class TaskPolicy {
+    Other, // SCHED_OTHER, weighted by nice
+    Fifo,  // SCHED_FIFO at priority; needs CAP_SYS_NICE or an RLIMIT_RTPRIO
+};
+
+// How a task thread is placed and scheduled. Anything the process is not
+// allowed to do (real-time policy, negative nice) is logged and skipped:
+// the thread still runs, with the default for that setting.
+struct TaskThreadConfig {
+    uint64_t cpuAffinity = 0;              // bit n = CPU n, 0: any CPU
+    TaskPolicy policy = TaskPolicy::Other;
+    int priority = 0;                      // Fifo: 1 (lowest) .. 99
+    int nice = 0;                          // Other, and Fifo when it is refused
+    size_t stackSize = 0;                  // bytes, 0: system default
+};
+
+// A joinable thread started with pthread attributes, since std::thread
+// cannot set the stack size. The thread names itself (pthread_setname_np,
+// first 15 characters) and applies affinity and scheduling before func runs.
+class TaskThread {
+public:
+    TaskThread() = default;
+    ~TaskThread();
+    TaskThread(TaskThread&& other) noexcept;
+    TaskThread& operator=(TaskThread&& other) noexcept;
+    TaskThread(const TaskThread&) = delete;
+    TaskThread& operator=(const TaskThread&) = delete;
+
+    bool start(const std::string& name, const TaskThreadConfig& config, std::function<void()> func);
+    bool joinable() const;
+    void join();
+
+private:
+    pthread_t thread = pthread_t();
+    bool started = false;
+};
+
+} // namespace AIOTEK
+
+#endif /* __AIOTEK_TASK_THREAD_HPP__ */
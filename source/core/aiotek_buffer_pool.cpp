@@ -0,0 +1,229 @@
+#include <memory>
+#include "aiotek_buffer_pool.hpp"
+
+namespace AIOTEK {
+
+namespace detail {
+
+struct BufferPoolStorage {
+    // One reference held by the BufferPool, one per block checked out.
+    std::atomic<size_t> refs{1};
+    size_t blockSize = 0;
+    std::unique_ptr<uint8_t[]> arena;
+    std::unique_ptr<BufferSlot[]> slots;
+    size_t slotCount = 0;
+    mutable std::mutex mutex;
+    std::vector<BufferSlot*> freeList;
+};
+
+static void unrefStorage(BufferPoolStorage* storage)
+{
+    if (storage->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete storage;
+}
+
+void releaseSlot(BufferSlot* slot)
+{
+    BufferPoolStorage* storage = slot->storage;
+    {
+        std::lock_guard<std::mutex> lock(storage->mutex);
+        storage->freeList.push_back(slot);
+    }
+    unrefStorage(storage);
+}
+
+} // namespace detail
+
+const char* BufferFormatToString(BufferFormat format)
+{
+    switch (format) {
+        case BufferFormat::Raw:
+            return "Raw";
+        case BufferFormat::YUYV:
+            return "YUYV";
+        case BufferFormat::NV12:
+            return "NV12";
+        case BufferFormat::MJPEG:
+            return "MJPEG";
+        case BufferFormat::H264:
+            return "H264";
+        case BufferFormat::PCM_S16LE:
+            return "PCM_S16LE";
+        default:
+            return "(invalid)";
+    }
+}
+
+MutableBuffer::MutableBuffer(detail::BufferSlot* slot, size_t capacity) : slot_(slot), capacity_(capacity)
+{
+}
+
+MutableBuffer::~MutableBuffer()
+{
+    if (slot_)
+        detail::releaseSlot(slot_);
+}
+
+MutableBuffer::MutableBuffer(MutableBuffer&& other) noexcept : slot_(other.slot_), capacity_(other.capacity_)
+{
+    other.slot_ = nullptr;
+}
+
+MutableBuffer& MutableBuffer::operator=(MutableBuffer&& other) noexcept
+{
+    if (this != &other) {
+        if (slot_)
+            detail::releaseSlot(slot_);
+        slot_ = other.slot_;
+        capacity_ = other.capacity_;
+        other.slot_ = nullptr;
+    }
+    return *this;
+}
+
+MutableBuffer::operator bool() const
+{
+    return slot_ != nullptr;
+}
+
+uint8_t* MutableBuffer::data()
+{
+    return slot_->data;
+}
+
+size_t MutableBuffer::capacity() const
+{
+    return capacity_;
+}
+
+void MutableBuffer::setSize(size_t size)
+{
+    slot_->size = size < capacity_ ? size : capacity_;
+}
+
+BufferInfo& MutableBuffer::info()
+{
+    return slot_->info;
+}
+
+BufferHandle MutableBuffer::publish() &&
+{
+    detail::BufferSlot* slot = slot_;
+    slot_ = nullptr;
+    return BufferHandle(slot);
+}
+
+BufferHandle::BufferHandle(detail::BufferSlot* slot) : slot_(slot)
+{
+    if (slot_)
+        slot_->refs.store(1, std::memory_order_release);
+}
+
+BufferHandle::~BufferHandle()
+{
+    if (slot_ && slot_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        detail::releaseSlot(slot_);
+}
+
+BufferHandle::BufferHandle(const BufferHandle& other) : slot_(other.slot_)
+{
+    if (slot_)
+        slot_->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+BufferHandle& BufferHandle::operator=(const BufferHandle& other)
+{
+    BufferHandle copy(other);
+    std::swap(slot_, copy.slot_);
+    return *this;
+}
+
+BufferHandle::BufferHandle(BufferHandle&& other) noexcept : slot_(other.slot_)
+{
+    other.slot_ = nullptr;
+}
+
+BufferHandle& BufferHandle::operator=(BufferHandle&& other) noexcept
+{
+    std::swap(slot_, other.slot_);
+    return *this;
+}
+
+BufferHandle::operator bool() const
+{
+    return slot_ != nullptr;
+}
+
+const uint8_t* BufferHandle::data() const
+{
+    return slot_->data;
+}
+
+size_t BufferHandle::size() const
+{
+    return slot_->size;
+}
+
+const BufferInfo& BufferHandle::info() const
+{
+    return slot_->info;
+}
+
+uint32_t BufferHandle::use_count() const
+{
+    return slot_ ? slot_->refs.load(std::memory_order_relaxed) : 0;
+}
+
+BufferPool::BufferPool(size_t blockSize, size_t blockCount) : storage_(new detail::BufferPoolStorage)
+{
+    storage_->blockSize = blockSize;
+    storage_->arena.reset(new uint8_t[blockSize * blockCount]);
+    storage_->slots.reset(new detail::BufferSlot[blockCount]);
+    storage_->slotCount = blockCount;
+    storage_->freeList.reserve(blockCount);
+    for (size_t i = blockCount; i-- > 0;) {
+        detail::BufferSlot& slot = storage_->slots[i];
+        slot.storage = storage_;
+        slot.data = storage_->arena.get() + i * blockSize;
+        storage_->freeList.push_back(&slot);
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    detail::unrefStorage(storage_);
+}
+
+MutableBuffer BufferPool::acquire()
+{
+    detail::BufferSlot* slot;
+    {
+        std::lock_guard<std::mutex> lock(storage_->mutex);
+        if (storage_->freeList.empty())
+            return MutableBuffer();
+        slot = storage_->freeList.back();
+        storage_->freeList.pop_back();
+    }
+    storage_->refs.fetch_add(1, std::memory_order_relaxed);
+    slot->size = 0;
+    slot->info = BufferInfo();
+    return MutableBuffer(slot, storage_->blockSize);
+}
+
+size_t BufferPool::blockSize() const
+{
+    return storage_->blockSize;
+}
+
+size_t BufferPool::blockCount() const
+{
+    return storage_->slotCount;
+}
+
+size_t BufferPool::available() const
+{
+    std::lock_guard<std::mutex> lock(storage_->mutex);
+    return storage_->freeList.size();
+}
+
+} // namespace AIOTEK
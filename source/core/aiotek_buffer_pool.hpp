@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace AIOTEK {
+
+enum class BufferFormat : uint8_t { Raw, YUYV, NV12, MJPEG, H264, PCM_S16LE };
+
+const char* BufferFormatToString(BufferFormat format);
+
+// Format metadata carried next to the bytes of a pooled buffer.
+struct BufferInfo {
+    BufferFormat format = BufferFormat::Raw;
+    uint16_t channels = 0;   // audio channels
+    uint32_t width = 0;      // video width in pixels
+    uint32_t height = 0;     // video height in pixels
+    uint32_t stride = 0;     // video bytes per line
+    uint32_t sampleRate = 0; // audio samples per second
+    uint64_t timestamp = 0;  // capture time in microseconds
+};
+
+class BufferPool;
+class BufferHandle;
+
+namespace detail {
+struct BufferPoolStorage;
+
+struct BufferSlot {
+    std::atomic<uint32_t> refs{0};
+    BufferPoolStorage* storage = nullptr;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    BufferInfo info;
+};
+
+void releaseSlot(BufferSlot* slot);
+} // namespace detail
+
+// Exclusive, writable view of a pool block. Fill it, then publish() it to
+// get a shareable read-only BufferHandle. Dropping it unpublished returns
+// the block to the pool.
+class MutableBuffer {
+  public:
+    MutableBuffer() = default;
+    ~MutableBuffer();
+    MutableBuffer(MutableBuffer&& other) noexcept;
+    MutableBuffer& operator=(MutableBuffer&& other) noexcept;
+    MutableBuffer(const MutableBuffer&) = delete;
+    MutableBuffer& operator=(const MutableBuffer&) = delete;
+
+    explicit operator bool() const;
+    uint8_t* data();
+    size_t capacity() const;
+    void setSize(size_t size);
+    BufferInfo& info();
+
+    BufferHandle publish() &&;
+
+  private:
+    friend class BufferPool;
+    MutableBuffer(detail::BufferSlot* slot, size_t capacity);
+
+    detail::BufferSlot* slot_ = nullptr;
+    size_t capacity_ = 0;
+};
+
+// Ref-counted, immutable handle to a pooled buffer. Copies share the same
+// bytes; the block returns to its pool when the last handle is dropped.
+class BufferHandle {
+  public:
+    BufferHandle() = default;
+    ~BufferHandle();
+    BufferHandle(const BufferHandle& other);
+    BufferHandle& operator=(const BufferHandle& other);
+    BufferHandle(BufferHandle&& other) noexcept;
+    BufferHandle& operator=(BufferHandle&& other) noexcept;
+
+    explicit operator bool() const;
+    const uint8_t* data() const;
+    size_t size() const;
+    const BufferInfo& info() const;
+    uint32_t use_count() const;
+
+  private:
+    friend class MutableBuffer;
+    explicit BufferHandle(detail::BufferSlot* slot);
+
+    detail::BufferSlot* slot_ = nullptr;
+};
+
+// Fixed number of equally sized blocks allocated up front. acquire() never
+// touches the heap. Outstanding buffers stay valid after the pool object
+// is destroyed; the storage is freed when the last one is released.
+class BufferPool {
+  public:
+    BufferPool(size_t blockSize, size_t blockCount);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Returns an empty MutableBuffer when every block is in use.
+    MutableBuffer acquire();
+
+    size_t blockSize() const;
+    size_t blockCount() const;
+    size_t available() const;
+
+  private:
+    detail::BufferPoolStorage* storage_;
+};
+
+} // namespace AIOTEK
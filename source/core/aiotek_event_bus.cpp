@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <mutex>
+#include "aiotek_event_bus.hpp"
+
+namespace AIOTEK {
+
+EventBus::EventBus(MailboxRegistry& registry) : registry_(registry)
+{
+}
+
+void EventBus::subscribe(TaskID task, const EventName& name)
+{
+    // A subscription is configuration: register the name.
+    EventName interned = EventName::intern(name.str());
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    exact_[interned].add(task);
+}
+
+void EventBus::subscribe_prefix(TaskID task, const std::string& prefix)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (const auto& entry : prefixes_) {
+        if (entry.first == prefix && entry.second == task)
+            return;
+    }
+    prefixes_.emplace_back(prefix, task);
+}
+
+void EventBus::unsubscribe(TaskID task)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (auto it = exact_.begin(); it != exact_.end();) {
+        it->second.remove(task);
+        if (it->second.empty())
+            it = exact_.erase(it);
+        else
+            ++it;
+    }
+    prefixes_.erase(std::remove_if(prefixes_.begin(), prefixes_.end(), [task](const auto& entry) { return entry.second == task; }),
+                    prefixes_.end());
+}
+
+TaskSet EventBus::subscribersOf(const EventName& name) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    TaskSet subscribers;
+    auto it = exact_.find(name);
+    if (it != exact_.end())
+        subscribers = it->second;
+    for (const auto& entry : prefixes_) {
+        if (name.starts_with(entry.first))
+            subscribers.add(entry.second);
+    }
+    return subscribers;
+}
+
+size_t EventBus::publish(TaskID sender, CustomEvent event)
+{
+    TaskSet subscribers = subscribersOf(event.name);
+    if (subscribers.empty())
+        return 0;
+    return registry_.multicast(sender, subscribers, std::move(event)).size();
+}
+
+EventBus g_eventBus(g_mailboxes);
+
+} // namespace AIOTEK
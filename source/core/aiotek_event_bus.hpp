@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "aiotek_mailbox.hpp"
+
+namespace AIOTEK {
+
+// In-process publish/subscribe on top of the mailbox registry. Tasks
+// subscribe to an exact event name or a name prefix ("net." matches
+// "net.state"; "" matches everything). publish() wraps the event in one
+// shared, immutable SharedEvent and enqueues that pointer to every
+// subscriber's mailbox, so the payload is never copied per subscriber.
+class EventBus {
+  public:
+    explicit EventBus(MailboxRegistry& registry);
+
+    void subscribe(TaskID task, const EventName& name);
+    void subscribe_prefix(TaskID task, const std::string& prefix);
+    void unsubscribe(TaskID task);
+
+    // Returns the number of mailboxes that accepted the event.
+    size_t publish(TaskID sender, CustomEvent event);
+
+  private:
+    TaskSet subscribersOf(const EventName& name) const;
+
+    MailboxRegistry& registry_;
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<EventName, TaskSet> exact_;
+    std::vector<std::pair<std::string, TaskID>> prefixes_;
+};
+
+extern EventBus g_eventBus;
+
+} // namespace AIOTEK
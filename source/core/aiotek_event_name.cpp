@@ -0,0 +1,155 @@
+#include <mutex>
+#include <utility>
+#include <unordered_set>
+#include "aiotek_event_name.hpp"
+
+namespace AIOTEK {
+
+// Node-based set: element addresses stay valid across rehashing. Never
+// destroyed so names stay valid during static destruction.
+static std::unordered_set<std::string>& internTable()
+{
+    static auto* table = new std::unordered_set<std::string>();
+    return *table;
+}
+
+static std::mutex& internMutex()
+{
+    static auto* mutex = new std::mutex();
+    return *mutex;
+}
+
+static const std::string* internString(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(internMutex());
+    return &*internTable().insert(name).first;
+}
+
+static const std::string* lookup(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(internMutex());
+    auto it = internTable().find(name);
+    return it != internTable().end() ? &*it : nullptr;
+}
+
+static const std::string* emptyName()
+{
+    static const std::string* empty = internString(std::string());
+    return empty;
+}
+
+// Tagged with EventName::kOwned; std::string is at least 2-byte aligned.
+static uintptr_t owned(const std::string& name)
+{
+    return reinterpret_cast<uintptr_t>(new std::string(name)) | 1;
+}
+
+static uintptr_t internedOrOwned(const std::string& name)
+{
+    if (const std::string* interned = lookup(name))
+        return reinterpret_cast<uintptr_t>(interned);
+    return owned(name);
+}
+
+EventName::EventName() : bits_(reinterpret_cast<uintptr_t>(emptyName()))
+{
+}
+
+EventName::EventName(uintptr_t bits) : bits_(bits)
+{
+}
+
+EventName::EventName(const std::string& name) : bits_(internedOrOwned(name))
+{
+}
+
+EventName::EventName(const char* name) : bits_(reinterpret_cast<uintptr_t>(internString(name ? std::string(name) : std::string())))
+{
+}
+
+EventName::EventName(const EventName& other) : bits_(other.interned() ? other.bits_ : owned(other.str()))
+{
+}
+
+EventName::EventName(EventName&& other) noexcept : bits_(other.bits_)
+{
+    other.bits_ = reinterpret_cast<uintptr_t>(emptyName());
+}
+
+EventName& EventName::operator=(const EventName& other)
+{
+    if (this != &other)
+        *this = EventName(other);
+    return *this;
+}
+
+EventName& EventName::operator=(EventName&& other) noexcept
+{
+    std::swap(bits_, other.bits_);
+    return *this;
+}
+
+EventName::~EventName()
+{
+    if (!interned())
+        delete &str();
+}
+
+EventName EventName::intern(const std::string& name)
+{
+    return EventName(reinterpret_cast<uintptr_t>(internString(name)));
+}
+
+const std::string& EventName::str() const
+{
+    return *reinterpret_cast<const std::string*>(bits_ & ~kOwned);
+}
+
+const char* EventName::c_str() const
+{
+    return str().c_str();
+}
+
+bool EventName::empty() const
+{
+    return str().empty();
+}
+
+bool EventName::starts_with(const std::string& prefix) const
+{
+    return str().compare(0, prefix.size(), prefix) == 0;
+}
+
+bool EventName::interned() const
+{
+    return (bits_ & kOwned) == 0;
+}
+
+bool EventName::operator==(const EventName& other) const
+{
+    if (interned() && other.interned())
+        return bits_ == other.bits_;
+    return str() == other.str();
+}
+
+bool EventName::operator!=(const EventName& other) const
+{
+    return !(*this == other);
+}
+
+bool EventName::operator<(const EventName& other) const
+{
+    return str() < other.str();
+}
+
+std::ostream& operator<<(std::ostream& os, const EventName& name)
+{
+    return os << name.str();
+}
+
+std::string operator+(const std::string& lhs, const EventName& rhs)
+{
+    return lhs + rhs.str();
+}
+
+} // namespace AIOTEK
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace AIOTEK {
+
+// Event name. Names known when the program is written or configured are
+// interned: stored once for the lifetime of the process, so an EventName
+// holding one is a single pointer to it, copying never allocates and
+// equality is a pointer compare. Names that only arrive at runtime (a
+// decoded envelope, a console line, an MQTT message) are not added to the
+// table, so outside input cannot grow it: such an EventName owns a copy of
+// the string and compares by value. Interning takes a lock, so hot senders
+// should keep their names in statics.
+class EventName {
+  public:
+    EventName();
+    // Uses the interned name if it is registered, otherwise owns a copy.
+    EventName(const std::string& name);
+    // Interns name: meant for string literals.
+    EventName(const char* name);
+    EventName(const EventName& other);
+    EventName(EventName&& other) noexcept;
+    EventName& operator=(const EventName& other);
+    EventName& operator=(EventName&& other) noexcept;
+    ~EventName();
+
+    // Registers name (configuration, subscriptions) and returns it interned.
+    static EventName intern(const std::string& name);
+
+    const std::string& str() const;
+    const char* c_str() const;
+    bool empty() const;
+    bool starts_with(const std::string& prefix) const;
+    // True if the name is interned, i.e. its str() address identifies it.
+    bool interned() const;
+
+    bool operator==(const EventName& other) const;
+    bool operator!=(const EventName& other) const;
+    bool operator<(const EventName& other) const;
+
+  private:
+    // Interned string, or an owned heap copy tagged with kOwned in bit 0.
+    static constexpr uintptr_t kOwned = 1;
+    explicit EventName(uintptr_t bits);
+    uintptr_t bits_;
+};
+
+std::ostream& operator<<(std::ostream& os, const EventName& name);
+std::string operator+(const std::string& lhs, const EventName& rhs);
+
+} // namespace AIOTEK
+
+namespace std {
+template <>
+struct hash<AIOTEK::EventName> {
+    size_t operator()(const AIOTEK::EventName& name) const
+    {
+        // By value: an owned name equals the interned one of the same spelling.
+        return std::hash<std::string>()(name.str());
+    }
+};
+} // namespace std
@@ -1,32 +1,934 @@
+#include <algorithm>
+#include <thread>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include "aiotek_mailbox.hpp"
+#include "aiotek_mailbox_ring.hpp"
+#include "aiotek_mailbox_recorder.hpp"
+#include "aiotek_mailbox_stats.hpp"
+#include "aiotek_log.hpp"
 
 namespace AIOTEK {
 
-void Mailbox::send(const MailboxEnvelope& env)
+// Yields a Block-policy Ring producer tries before parking in waitForRingRoom().
+static constexpr size_t kRingProducerSpins = 64;
+
+MailboxPriority MailboxLaneOf(const MailboxEnvelope& env)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    queue_.push(env);
+    if (env.priority != MailboxPriority::Auto)
+        return env.priority;
+    if (std::holds_alternative<SignalEvent>(env.payload) || std::holds_alternative<ErrorEvent>(env.payload))
+        return MailboxPriority::High;
+    return MailboxPriority::Normal;
+}
+
+void MailboxEnvelope::expire_after(std::chrono::milliseconds timeout)
+{
+    ttl = static_cast<uint16_t>(std::min(std::max(timeout, std::chrono::milliseconds(1)), kMailboxMaxTtl).count());
+}
+
+const char* MailboxStatusToString(MailboxStatus status)
+{
+    switch (status) {
+        case MailboxStatus::Ok:
+            return "Ok";
+        case MailboxStatus::Rejected:
+            return "Rejected";
+        case MailboxStatus::Dropped:
+            return "Dropped";
+        case MailboxStatus::Timeout:
+            return "Timeout";
+        case MailboxStatus::NoReceiver:
+            return "NoReceiver";
+        case MailboxStatus::Closed:
+            return "Closed";
+        case MailboxStatus::Throttled:
+            return "Throttled";
+        default:
+            return "(invalid)";
+    }
+}
+
+Mailbox::Mailbox() = default;
+
+Mailbox::~Mailbox()
+{
+    if (eventFd_ >= 0)
+        ::close(eventFd_);
+}
+
+void Mailbox::configure(const MailboxConfig& config)
+{
+    config_ = config;
+    if (config_.eventfd && eventFd_ < 0) {
+        eventFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (eventFd_ < 0) {
+            AIOTEK_LOG_ERROR("Mailbox: eventfd() failed, readiness notification disabled");
+            config_.eventfd = false;
+        }
+    } else if (!config_.eventfd && eventFd_ >= 0) {
+        ::close(eventFd_);
+        eventFd_ = -1;
+    }
+    readinessSignaled_.store(false, std::memory_order_relaxed);
+    closed_.store(false, std::memory_order_relaxed);
+    laneCredits_ = config_.laneWeights;
+    latest_.clear();
+    if (config_.backend == MailboxBackend::Ring) {
+        if (config_.coalesce != MailboxCoalesce::None) {
+            AIOTEK_LOG_WARNING("Mailbox: coalescing needs the Queue backend, disabled");
+            config_.coalesce = MailboxCoalesce::None;
+        }
+        if (config_.fairness != MailboxFairness::Fifo) {
+            AIOTEK_LOG_WARNING("Mailbox: per-sender fairness needs the Queue backend, disabled");
+            config_.fairness = MailboxFairness::Fifo;
+        }
+        for (auto& limit : config_.senderLimits) {
+            if (limit.rate != 0) {
+                AIOTEK_LOG_WARNING("Mailbox: sender rate limits need the Queue backend, disabled");
+                config_.senderLimits = {};
+                break;
+            }
+        }
+        if (config_.capacity == 0)
+            config_.capacity = kDefaultRingCapacity;
+        ring_ = std::make_unique<MailboxRing>(config_.capacity);
+        config_.capacity = ring_->capacity();
+    } else {
+        ring_.reset();
+    }
+    resetLanes();
+    auto now = Clock::now();
+    for (size_t sender = 0; sender < kTaskCount; ++sender) {
+        const MailboxRateLimit& limit = config_.senderLimits[sender];
+        buckets_[sender].tokens = limit.burst ? limit.burst : limit.rate;
+        buckets_[sender].refilled = now;
+    }
+}
+
+static size_t queueOf(const MailboxEnvelope& env, size_t queues)
+{
+    auto sender = static_cast<size_t>(env.sender);
+    return sender < queues ? sender : 0;
+}
+
+void Mailbox::resetLanes()
+{
+    size_t queues = config_.fairness == MailboxFairness::RoundRobin ? kTaskCount : 1;
+    for (auto& lane : lanes_) {
+        if (lane.queues.size() == queues)
+            continue;
+        // Regroup anything already pending; each sender keeps its order.
+        std::vector<std::deque<MailboxEnvelope>> regrouped(queues);
+        for (auto& queue : lane.queues) {
+            for (auto& env : queue)
+                regrouped[queueOf(env, queues)].push_back(std::move(env));
+        }
+        lane.queues = std::move(regrouped);
+        lane.next = 0;
+    }
+}
+
+const MailboxConfig& Mailbox::config() const
+{
+    return config_;
+}
+
+void Mailbox::notifyConsumer()
+{
+    // Pairs with the fence in receive(): either the consumer sees the new
+    // element on its re-check, or we see it parked and wake it.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumerWaiting_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cond_.notify_one();
+    }
+}
+
+MailboxStatus Mailbox::send(const MailboxEnvelope& env)
+{
+    return send(MailboxEnvelope(env));
+}
+
+MailboxStatus Mailbox::send(MailboxEnvelope&& env)
+{
+    return push(std::move(env), true);
+}
+
+MailboxStatus Mailbox::try_send(MailboxEnvelope&& env)
+{
+    return push(std::move(env), false);
+}
+
+MailboxStatus Mailbox::push(MailboxEnvelope&& env, bool block)
+{
+    env.sequence = static_cast<uint16_t>(nextSequence_.fetch_add(1, std::memory_order_relaxed));
+    if (config_.instrumented || env.ttl)
+        env.enqueued = MailboxClockUs();
+    if (ring_)
+        return sendRing(std::move(env), block);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (closed_.load(std::memory_order_relaxed))
+        return MailboxStatus::Closed;
+    // The consumer was already woken for the envelope being replaced.
+    if (config_.coalesce != MailboxCoalesce::None && coalesceLocked(env))
+        return MailboxStatus::Ok;
+    // After coalescing: an update that replaces a pending one adds no load.
+    if (throttleLocked(env))
+        return MailboxStatus::Throttled;
+    // Full: first make room by dropping envelopes that expired while queued.
+    if (config_.capacity != 0 && pending_ >= config_.capacity && ttlPending_ && purgeExpiredLocked())
+        notifyProducersLocked();
+    if (config_.capacity != 0 && pending_ >= config_.capacity) {
+        switch (config_.overflow) {
+            case MailboxOverflow::Reject:
+                counters_.rejected.fetch_add(1, std::memory_order_relaxed);
+                return MailboxStatus::Rejected;
+            case MailboxOverflow::DropNewest:
+                counters_.droppedNewest.fetch_add(1, std::memory_order_relaxed);
+                return MailboxStatus::Dropped;
+            case MailboxOverflow::DropOldest:
+                dropOldestLocked();
+                break;
+            case MailboxOverflow::Block:
+                if (!block) {
+                    counters_.rejected.fetch_add(1, std::memory_order_relaxed);
+                    return MailboxStatus::Rejected;
+                }
+                counters_.blocked.fetch_add(1, std::memory_order_relaxed);
+                if (!waitForRoomLocked(lock)) {
+                    if (closed_.load(std::memory_order_relaxed))
+                        return MailboxStatus::Closed;
+                    counters_.timedOut.fetch_add(1, std::memory_order_relaxed);
+                    return MailboxStatus::Timeout;
+                }
+                break;
+        }
+    }
+    pushLocked(std::move(env));
+    counters_.sent.fetch_add(1, std::memory_order_relaxed);
+    noteDepth(pending_);
+    lock.unlock();
     cond_.notify_one();
+    signalReadiness();
+    return MailboxStatus::Ok;
+}
+
+MailboxStatus Mailbox::sendRing(MailboxEnvelope&& env, bool block)
+{
+    if (closed_.load(std::memory_order_acquire))
+        return MailboxStatus::Closed;
+    if (!ring_->try_push(std::move(env))) {
+        switch (config_.overflow) {
+            case MailboxOverflow::Reject:
+                counters_.rejected.fetch_add(1, std::memory_order_relaxed);
+                return MailboxStatus::Rejected;
+            case MailboxOverflow::DropNewest:
+                counters_.droppedNewest.fetch_add(1, std::memory_order_relaxed);
+                return MailboxStatus::Dropped;
+            case MailboxOverflow::DropOldest: {
+                // The ring tolerates concurrent pops, so a producer may evict.
+                MailboxEnvelope oldest;
+                do {
+                    if (ring_->try_pop(oldest))
+                        counters_.droppedOldest.fetch_add(1, std::memory_order_relaxed);
+                } while (!ring_->try_push(std::move(env)));
+                break;
+            }
+            case MailboxOverflow::Block: {
+                if (!block) {
+                    counters_.rejected.fetch_add(1, std::memory_order_relaxed);
+                    return MailboxStatus::Rejected;
+                }
+                counters_.blocked.fetch_add(1, std::memory_order_relaxed);
+                bool forever = config_.blockTimeout == kMailboxWaitForever;
+                auto deadline = forever ? Clock::time_point::max() : Clock::now() + config_.blockTimeout;
+                // A consumer usually frees a slot within a few yields. Past
+                // that, park: a SCHED_FIFO producer that only yields never
+                // lets a lower-priority consumer run on a single core.
+                size_t spins = 0;
+                while (!ring_->try_push(std::move(env))) {
+                    if (closed_.load(std::memory_order_acquire))
+                        return MailboxStatus::Closed;
+                    if (spins < kRingProducerSpins) {
+                        ++spins;
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    if (waitForRingRoom(deadline))
+                        continue;
+                    // Timed out: one last try. env is moved only on success.
+                    if (ring_->try_push(std::move(env)))
+                        break;
+                    if (closed_.load(std::memory_order_acquire))
+                        return MailboxStatus::Closed;
+                    counters_.timedOut.fetch_add(1, std::memory_order_relaxed);
+                    return MailboxStatus::Timeout;
+                }
+                break;
+            }
+        }
+    }
+    counters_.sent.fetch_add(1, std::memory_order_relaxed);
+    noteDepth(ring_->size());
+    notifyConsumer();
+    signalReadiness();
+    return MailboxStatus::Ok;
+}
+
+bool Mailbox::waitForRoomLocked(std::unique_lock<std::mutex>& lock)
+{
+    auto hasRoom = [this] { return pending_ < config_.capacity || closed_.load(std::memory_order_relaxed); };
+    ++blockedProducers_;
+    bool ok = true;
+    if (config_.blockTimeout == kMailboxWaitForever)
+        notFull_.wait(lock, hasRoom);
+    else
+        ok = notFull_.wait_for(lock, config_.blockTimeout, hasRoom);
+    --blockedProducers_;
+    return ok && !closed_.load(std::memory_order_relaxed);
+}
+
+bool Mailbox::throttleLocked(const MailboxEnvelope& env)
+{
+    auto sender = static_cast<size_t>(env.sender);
+    if (sender >= kTaskCount || config_.senderLimits[sender].rate == 0)
+        return false;
+    const MailboxRateLimit& limit = config_.senderLimits[sender];
+    double burst = limit.burst ? limit.burst : limit.rate;
+    TokenBucket& bucket = buckets_[sender];
+    auto now = Clock::now();
+    bucket.tokens = std::min(burst, bucket.tokens + std::chrono::duration<double>(now - bucket.refilled).count() * limit.rate);
+    bucket.refilled = now;
+    if (bucket.tokens < 1.0) {
+        counters_.throttled.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    bucket.tokens -= 1.0;
+    return false;
 }
 
-MailboxEnvelope Mailbox::receive()
+void Mailbox::dropOldestLocked()
+{
+    for (size_t lane = kMailboxLanes; lane-- > 0;) {
+        if (lanes_[lane].size != 0) {
+            // Under RoundRobin evict from the longest queue: the sender
+            // causing the backlog pays for it.
+            const auto& queues = lanes_[lane].queues;
+            size_t victim = 0;
+            for (size_t queue = 1; queue < queues.size(); ++queue) {
+                if (queues[queue].size() > queues[victim].size())
+                    victim = queue;
+            }
+            popFrontLocked(lane, victim, nullptr);
+            counters_.droppedOldest.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+bool Mailbox::coalesceKey(const MailboxEnvelope& env, uintptr_t& key) const
+{
+    // Every request, acked envelope, signal and error must arrive on its own.
+    if (env.flags & (kEnvelopeRequest | kEnvelopeAck))
+        return false;
+    // Names are keyed by the address of their interned string; kinds by
+    // variant index + 1, which can never collide with an address. A name
+    // that is not interned has no stable address and is not coalesced.
+    if (const auto* event = std::get_if<CustomEvent>(&env.payload)) {
+        key = reinterpret_cast<uintptr_t>(&event->name.str());
+        return event->name.interned();
+    }
+    if (const auto* shared = std::get_if<SharedEvent>(&env.payload)) {
+        if (!shared->event)
+            return false;
+        key = reinterpret_cast<uintptr_t>(&shared->event->name.str());
+        return shared->event->name.interned();
+    }
+    if (config_.coalesce != MailboxCoalesce::ByKind)
+        return false;
+    if (std::holds_alternative<SignalEvent>(env.payload) || std::holds_alternative<ErrorEvent>(env.payload))
+        return false;
+    key = env.payload.index() + 1;
+    return true;
+}
+
+bool Mailbox::coalesceLocked(MailboxEnvelope& env)
+{
+    uintptr_t key;
+    if (!coalesceKey(env, key))
+        return false;
+    auto it = latest_.find(key);
+    if (it == latest_.end())
+        return false;
+    // Replace in place only where pushLocked() would have put env: same
+    // lane, and under RoundRobin the same sender queue. Otherwise queue it
+    // normally; it becomes the pending envelope for its key.
+    const MailboxEnvelope& pending = *it->second;
+    size_t queues = lanes_[0].queues.size();
+    if (MailboxLaneOf(pending) != MailboxLaneOf(env) || queueOf(pending, queues) != queueOf(env, queues))
+        return false;
+    ttlPending_ |= env.ttl != 0;
+    *it->second = std::move(env);
+    counters_.sent.fetch_add(1, std::memory_order_relaxed);
+    counters_.coalesced.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void Mailbox::popFrontLocked(size_t lane, size_t queue, MailboxEnvelope* out)
+{
+    MailboxEnvelope& front = lanes_[lane].queues[queue].front();
+    uintptr_t key;
+    // Forget the key before moving out: a moved-from payload has lost it.
+    if (!latest_.empty() && coalesceKey(front, key)) {
+        auto it = latest_.find(key);
+        if (it != latest_.end() && it->second == &front)
+            latest_.erase(it);
+    }
+    if (out)
+        *out = std::move(front);
+    lanes_[lane].queues[queue].pop_front();
+    --lanes_[lane].size;
+    --pending_;
+}
+
+size_t Mailbox::nextQueueLocked(size_t lane)
+{
+    Lane& entry = lanes_[lane];
+    size_t count = entry.queues.size();
+    for (size_t step = 0; step < count; ++step) {
+        size_t queue = (entry.next + step) % count;
+        if (!entry.queues[queue].empty()) {
+            entry.next = (queue + 1) % count;
+            return queue;
+        }
+    }
+    return 0;
+}
+
+bool Mailbox::expiredAt(const MailboxEnvelope& env, uint32_t nowUs)
+{
+    if (env.ttl == 0)
+        return false;
+    // Uninstrumented mailboxes don't read the clock per dequeue; read it
+    // only for envelopes that need it.
+    if (!config_.instrumented)
+        nowUs = MailboxClockUs();
+    if (nowUs - env.enqueued < uint32_t(env.ttl) * 1000)
+        return false;
+    counters_.expired.fetch_add(1, std::memory_order_relaxed);
+    g_mailboxStats.record_expired(env.sender, env.receiver);
+    return true;
+}
+
+size_t Mailbox::purgeExpiredLocked()
+{
+    uint32_t nowUs = MailboxClockUs();
+    size_t purged = 0;
+    bool ttlLeft = false;
+    for (auto& lane : lanes_) {
+        for (auto& queue : lane.queues) {
+            auto kept = std::remove_if(queue.begin(), queue.end(), [&](const MailboxEnvelope& env) {
+                if (expiredAt(env, nowUs))
+                    return true;
+                ttlLeft |= env.ttl != 0;
+                return false;
+            });
+            auto removed = static_cast<size_t>(queue.end() - kept);
+            queue.erase(kept, queue.end());
+            lane.size -= removed;
+            purged += removed;
+        }
+    }
+    ttlPending_ = ttlLeft;
+    if (purged == 0)
+        return 0;
+    pending_ -= purged;
+    // Erasing from the middle of a deque moves envelopes: re-point the
+    // coalescing index.
+    if (!latest_.empty()) {
+        latest_.clear();
+        uintptr_t key;
+        for (auto& lane : lanes_) {
+            for (auto& queue : lane.queues) {
+                for (auto& env : queue) {
+                    if (coalesceKey(env, key))
+                        latest_[key] = &env;
+                }
+            }
+        }
+    }
+    return purged;
+}
+
+void Mailbox::notifyProducersLocked()
+{
+    if (blockedProducers_ != 0)
+        notFull_.notify_all();
+}
+
+bool Mailbox::waitForRing(Clock::time_point deadline)
 {
     std::unique_lock<std::mutex> lock(mutex_);
-    cond_.wait(lock, [this] { return !queue_.empty(); });
-    auto env = queue_.front();
-    queue_.pop();
-    return env;
+    consumerWaiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool inTime = true;
+    if (ring_->empty() && !closed_.load(std::memory_order_relaxed)) {
+        if (deadline == Clock::time_point::max())
+            cond_.wait(lock);
+        else
+            inTime = cond_.wait_until(lock, deadline) == std::cv_status::no_timeout;
+    }
+    consumerWaiting_.store(false, std::memory_order_relaxed);
+    return inTime;
+}
+
+void Mailbox::notifyRingProducers()
+{
+    // Same handshake as notifyConsumer(), with the roles swapped.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ringProducersWaiting_.load(std::memory_order_relaxed) != 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        notFull_.notify_all();
+    }
+}
+
+bool Mailbox::waitForRingRoom(Clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    ringProducersWaiting_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool inTime = true;
+    if (ring_->size() >= ring_->capacity() && !closed_.load(std::memory_order_relaxed)) {
+        if (deadline == Clock::time_point::max())
+            notFull_.wait(lock);
+        else
+            inTime = notFull_.wait_until(lock, deadline) == std::cv_status::no_timeout;
+    }
+    ringProducersWaiting_.fetch_sub(1, std::memory_order_relaxed);
+    return inTime;
+}
+
+bool Mailbox::waitPendingLocked(std::unique_lock<std::mutex>& lock, Clock::time_point deadline)
+{
+    auto ready = [this] { return pending_ != 0 || closed_.load(std::memory_order_relaxed); };
+    if (deadline == Clock::time_point::max())
+        cond_.wait(lock, ready);
+    else
+        cond_.wait_until(lock, deadline, ready);
+    return pending_ != 0;
+}
+
+size_t Mailbox::popRing(std::vector<MailboxEnvelope>& out, size_t max)
+{
+    size_t count = 0;
+    bool popped = false;
+    uint32_t nowUs = dequeueClock();
+    MailboxEnvelope env;
+    while (count < max && ring_->try_pop(env)) {
+        popped = true;
+        if (expiredAt(env, nowUs))
+            continue;
+        onDequeued(env, nowUs);
+        out.push_back(std::move(env));
+        ++count;
+    }
+    if (popped)
+        notifyRingProducers();
+    return count;
+}
+
+void Mailbox::pushLocked(MailboxEnvelope&& env)
+{
+    Lane& lane = lanes_[static_cast<size_t>(MailboxLaneOf(env))];
+    auto& queue = lane.queues[queueOf(env, lane.queues.size())];
+    ttlPending_ |= env.ttl != 0;
+    queue.push_back(std::move(env));
+    ++lane.size;
+    ++pending_;
+    uintptr_t key;
+    if (config_.coalesce != MailboxCoalesce::None && coalesceKey(queue.back(), key))
+        latest_[key] = &queue.back();
+}
+
+size_t Mailbox::nextLaneLocked()
+{
+    if (config_.dequeue == MailboxDequeue::Strict) {
+        for (size_t lane = 0; lane < kMailboxLanes; ++lane) {
+            if (lanes_[lane].size != 0)
+                return lane;
+        }
+        return kMailboxLanes;
+    }
+    // Weighted: highest non-empty lane that still has credit; once every
+    // non-empty lane is out of credit, start a new round.
+    for (int round = 0; round < 2; ++round) {
+        for (size_t lane = 0; lane < kMailboxLanes; ++lane) {
+            if (lanes_[lane].size != 0 && laneCredits_[lane] > 0) {
+                --laneCredits_[lane];
+                return lane;
+            }
+        }
+        laneCredits_ = config_.laneWeights;
+    }
+    // All weights of non-empty lanes are zero: fall back to strict order.
+    for (size_t lane = 0; lane < kMailboxLanes; ++lane) {
+        if (lanes_[lane].size != 0)
+            return lane;
+    }
+    return kMailboxLanes;
+}
+
+bool Mailbox::popLocked(MailboxEnvelope& out, uint32_t nowUs)
+{
+    while (pending_ != 0) {
+        size_t lane = nextLaneLocked();
+        popFrontLocked(lane, nextQueueLocked(lane), &out);
+        notifyProducersLocked();
+        if (expiredAt(out, nowUs))
+            continue;
+        onDequeued(out, nowUs);
+        return true;
+    }
+    ttlPending_ = false;
+    return false;
+}
+
+size_t Mailbox::popQueue(std::vector<MailboxEnvelope>& out, size_t max)
+{
+    size_t count = 0;
+    uint32_t nowUs = dequeueClock();
+    MailboxEnvelope env;
+    while (count < max && popLocked(env, nowUs)) {
+        out.push_back(std::move(env));
+        ++count;
+    }
+    return count;
+}
+
+std::optional<MailboxEnvelope> Mailbox::receive()
+{
+    return receive_until(Clock::time_point::max());
+}
+
+std::optional<MailboxEnvelope> Mailbox::receive_for(std::chrono::milliseconds timeout)
+{
+    return receive_until(deadlineAfter(timeout));
+}
+
+std::optional<MailboxEnvelope> Mailbox::receive_until(Clock::time_point deadline)
+{
+    MailboxEnvelope env;
+    if (ring_) {
+        while (true) {
+            while (!ring_->try_pop(env)) {
+                if (closed_.load(std::memory_order_acquire) && ring_->empty())
+                    return std::nullopt;
+                if (!waitForRing(deadline)) {
+                    // Timed out: one last look, and keep what it finds.
+                    if (ring_->try_pop(env))
+                        break;
+                    return std::nullopt;
+                }
+            }
+            notifyRingProducers();
+            uint32_t nowUs = dequeueClock();
+            if (!expiredAt(env, nowUs)) {
+                onDequeued(env, nowUs);
+                return env;
+            }
+        }
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Everything pending may turn out expired: then wait again.
+    while (waitPendingLocked(lock, deadline)) {
+        if (popLocked(env, dequeueClock()))
+            return env;
+    }
+    return std::nullopt;
 }
 
 std::optional<MailboxEnvelope> Mailbox::try_receive()
 {
+    if (ring_) {
+        MailboxEnvelope env;
+        while (ring_->try_pop(env)) {
+            notifyRingProducers();
+            uint32_t nowUs = dequeueClock();
+            if (!expiredAt(env, nowUs)) {
+                onDequeued(env, nowUs);
+                return env;
+            }
+        }
+        return std::nullopt;
+    }
     std::lock_guard<std::mutex> lock(mutex_);
-    if (queue_.empty())
+    MailboxEnvelope env;
+    if (!popLocked(env, dequeueClock()))
         return std::nullopt;
-    auto env = queue_.front();
-    queue_.pop();
     return env;
 }
 
-Mailbox g_mailbox;
+size_t Mailbox::receive_batch(std::vector<MailboxEnvelope>& out, size_t max)
+{
+    return receiveBatchUntil(out, max, Clock::time_point::max());
+}
+
+size_t Mailbox::receive_batch_for(std::vector<MailboxEnvelope>& out, size_t max, std::chrono::milliseconds timeout)
+{
+    return receiveBatchUntil(out, max, deadlineAfter(timeout));
+}
+
+size_t Mailbox::receiveBatchUntil(std::vector<MailboxEnvelope>& out, size_t max, Clock::time_point deadline)
+{
+    if (max == 0)
+        return 0;
+    if (ring_) {
+        size_t count;
+        while ((count = popRing(out, max)) == 0) {
+            if (closed_.load(std::memory_order_acquire) && ring_->empty())
+                return 0;
+            if (!waitForRing(deadline))
+                return popRing(out, max);
+        }
+        return count;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (waitPendingLocked(lock, deadline)) {
+        if (size_t count = popQueue(out, max))
+            return count;
+    }
+    return 0;
+}
+
+size_t Mailbox::drain(std::vector<MailboxEnvelope>& out)
+{
+    if (ring_)
+        return popRing(out, SIZE_MAX);
+    std::lock_guard<std::mutex> lock(mutex_);
+    return popQueue(out, SIZE_MAX);
+}
+
+void Mailbox::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_.store(true, std::memory_order_release);
+    }
+    cond_.notify_all();
+    notFull_.notify_all();
+    signalReadiness();
+}
+
+void Mailbox::reopen()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_.store(false, std::memory_order_release);
+}
+
+bool Mailbox::closed() const
+{
+    return closed_.load(std::memory_order_acquire);
+}
+
+Mailbox::Clock::time_point Mailbox::deadlineAfter(std::chrono::milliseconds timeout)
+{
+    auto now = Clock::now();
+    if (timeout >= std::chrono::duration_cast<std::chrono::milliseconds>(Clock::time_point::max() - now))
+        return Clock::time_point::max();
+    return now + timeout;
+}
+
+uint32_t Mailbox::dequeueClock() const
+{
+    return config_.instrumented ? MailboxClockUs() : 0;
+}
+
+void Mailbox::onDequeued(const MailboxEnvelope& env, uint32_t nowUs)
+{
+    counters_.received.fetch_add(1, std::memory_order_relaxed);
+    if (config_.instrumented)
+        g_mailboxStats.record(env.sender, env.receiver, nowUs - env.enqueued);
+}
+
+void Mailbox::noteDepth(size_t depth)
+{
+    size_t high = highWatermark_.load(std::memory_order_relaxed);
+    while (depth > high && !highWatermark_.compare_exchange_weak(high, depth, std::memory_order_relaxed)) {
+    }
+}
+
+void Mailbox::signalReadiness()
+{
+    if (eventFd_ < 0)
+        return;
+    // Coalesce: only the first send after clear_readiness() touches the fd.
+    if (readinessSignaled_.exchange(true, std::memory_order_acq_rel))
+        return;
+    uint64_t one = 1;
+    if (::write(eventFd_, &one, sizeof(one)) < 0) {
+        // EAGAIN means the counter is already non-zero: still readable.
+    }
+}
+
+int Mailbox::readiness_fd() const
+{
+    return eventFd_;
+}
+
+void Mailbox::clear_readiness()
+{
+    if (eventFd_ < 0)
+        return;
+    // Read, then re-arm. Re-arming first would let a producer's write land
+    // in between and be consumed by this read, leaving the flag set with
+    // the counter at 0: no later send would ever write again. A send that
+    // skipped its write before the re-arm is picked up by the drain that
+    // follows this call.
+    uint64_t value;
+    if (::read(eventFd_, &value, sizeof(value)) < 0) {
+        // EAGAIN: nothing was pending.
+    }
+    readinessSignaled_.store(false, std::memory_order_seq_cst);
+}
+
+size_t Mailbox::depth() const
+{
+    if (ring_)
+        return ring_->size();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+}
+
+size_t Mailbox::high_watermark() const
+{
+    return highWatermark_.load(std::memory_order_relaxed);
+}
+
+MailboxCounters Mailbox::counters() const
+{
+    MailboxCounters snapshot;
+    snapshot.sent = counters_.sent.load(std::memory_order_relaxed);
+    snapshot.received = counters_.received.load(std::memory_order_relaxed);
+    snapshot.droppedOldest = counters_.droppedOldest.load(std::memory_order_relaxed);
+    snapshot.droppedNewest = counters_.droppedNewest.load(std::memory_order_relaxed);
+    snapshot.rejected = counters_.rejected.load(std::memory_order_relaxed);
+    snapshot.blocked = counters_.blocked.load(std::memory_order_relaxed);
+    snapshot.timedOut = counters_.timedOut.load(std::memory_order_relaxed);
+    snapshot.coalesced = counters_.coalesced.load(std::memory_order_relaxed);
+    snapshot.expired = counters_.expired.load(std::memory_order_relaxed);
+    snapshot.throttled = counters_.throttled.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+Mailbox& MailboxRegistry::get(TaskID id)
+{
+    auto index = static_cast<size_t>(id);
+    if (index >= mailboxes_.size())
+        index = static_cast<size_t>(TaskID::Unknown);
+    return mailboxes_[index];
+}
+
+void MailboxRegistry::configure(TaskID id, const MailboxConfig& config)
+{
+    get(id).configure(config);
+}
+
+Mailbox* MailboxRegistry::route(const MailboxEnvelope& env)
+{
+    auto index = static_cast<size_t>(env.receiver);
+    if (env.receiver == TaskID::Unknown || index >= mailboxes_.size()) {
+        AIOTEK_LOG_WARNING(std::string("Mailbox: Dropping message from ") + TaskIDToString(env.sender) + " with no valid receiver");
+        return nullptr;
+    }
+    // A replay that recorded itself would feed back into the log.
+    if (!(env.flags & kEnvelopeReplayed)) {
+        if (MailboxRecorder* recorder = recorder_.load(std::memory_order_acquire))
+            recorder->record(env);
+    }
+    if (demandArmed_[index].load(std::memory_order_acquire))
+        demand(index);
+    return &mailboxes_[index];
+}
+
+void MailboxRegistry::on_demand(TaskID id, std::function<void()> activate)
+{
+    auto index = static_cast<size_t>(id);
+    if (id == TaskID::Unknown || index >= mailboxes_.size())
+        return;
+    std::lock_guard<std::mutex> lock(demandMutex_);
+    demandArmed_[index].store(static_cast<bool>(activate), std::memory_order_release);
+    demand_[index] = std::move(activate);
+}
+
+void MailboxRegistry::demand(size_t index)
+{
+    std::function<void()> activate;
+    {
+        std::lock_guard<std::mutex> lock(demandMutex_);
+        if (!demandArmed_[index].exchange(false, std::memory_order_acq_rel))
+            return; // another sender got here first
+        activate = std::move(demand_[index]);
+        demand_[index] = nullptr;
+    }
+    // Outside the lock: activation may start a task that sends right away.
+    activate();
+}
+
+void MailboxRegistry::close_all()
+{
+    for (auto& mailbox : mailboxes_)
+        mailbox.close();
+}
+
+void MailboxRegistry::set_recorder(MailboxRecorder* recorder)
+{
+    recorder_.store(recorder, std::memory_order_release);
+}
+
+MailboxStatus MailboxRegistry::send(const MailboxEnvelope& env)
+{
+    Mailbox* mailbox = route(env);
+    if (!mailbox)
+        return MailboxStatus::NoReceiver;
+    return mailbox->send(env);
+}
+
+MailboxStatus MailboxRegistry::send(MailboxEnvelope&& env)
+{
+    Mailbox* mailbox = route(env);
+    if (!mailbox)
+        return MailboxStatus::NoReceiver;
+    return mailbox->send(std::move(env));
+}
+
+MailboxStatus MailboxRegistry::try_send(MailboxEnvelope&& env)
+{
+    Mailbox* mailbox = route(env);
+    if (!mailbox)
+        return MailboxStatus::NoReceiver;
+    return mailbox->try_send(std::move(env));
+}
+
+TaskSet MailboxRegistry::multicast(MailboxEnvelope env, TaskSet receivers)
+{
+    if (auto* event = std::get_if<CustomEvent>(&env.payload))
+        env.payload = SharedEvent{std::make_shared<const CustomEvent>(std::move(*event))};
+    TaskSet delivered;
+    receivers.for_each([&](TaskID receiver) {
+        env.receiver = receiver;
+        if (send(env) == MailboxStatus::Ok)
+            delivered.add(receiver);
+    });
+    return delivered;
+}
+
+TaskSet MailboxRegistry::multicast(TaskID sender, TaskSet receivers, MailboxMessage payload)
+{
+    return multicast(MailboxEnvelope(sender, TaskID::Unknown, std::move(payload)), receivers);
+}
+
+MailboxRegistry g_mailboxes;
 } // namespace AIOTEK
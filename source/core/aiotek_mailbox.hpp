@@ -1,15 +1,26 @@
 #pragma once
 #include <variant>
 #include <string>
-#include <queue>
+#include <array>
+#include <deque>
+#include <cstdint>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <memory>
 #include <optional>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <initializer_list>
+#include <functional>
 #include <iostream>
+#include "aiotek_buffer_pool.hpp"
+#include "aiotek_event_name.hpp"
 
 namespace AIOTEK {
 
-enum class TaskID {
+enum class TaskID : uint8_t {
     Unknown = 0,
     Console,
     Sender,
@@ -20,6 +31,67 @@ enum class TaskID {
     MQTT,
 };
 
+constexpr size_t kTaskCount = static_cast<size_t>(TaskID::MQTT) + 1;
+
+// Receiver set for MailboxRegistry::multicast(), one bit per TaskID.
+class TaskSet {
+  public:
+    constexpr TaskSet() = default;
+    constexpr TaskSet(std::initializer_list<TaskID> ids)
+    {
+        for (TaskID id : ids)
+            add(id);
+    }
+
+    // Every task except Unknown.
+    static constexpr TaskSet all()
+    {
+        TaskSet set;
+        set.bits_ = ((uint32_t(1) << kTaskCount) - 1) & ~uint32_t(1);
+        return set;
+    }
+
+    constexpr TaskSet& add(TaskID id)
+    {
+        bits_ |= bit(id);
+        return *this;
+    }
+    constexpr TaskSet& remove(TaskID id)
+    {
+        bits_ &= ~bit(id);
+        return *this;
+    }
+    constexpr bool contains(TaskID id) const { return (bits_ & bit(id)) != 0; }
+    constexpr bool empty() const { return bits_ == 0; }
+    size_t size() const { return static_cast<size_t>(__builtin_popcount(bits_)); }
+
+    constexpr TaskSet operator|(TaskSet other) const { return fromBits(bits_ | other.bits_); }
+    constexpr TaskSet operator&(TaskSet other) const { return fromBits(bits_ & other.bits_); }
+    constexpr TaskSet operator-(TaskSet other) const { return fromBits(bits_ & ~other.bits_); }
+    constexpr bool operator==(TaskSet other) const { return bits_ == other.bits_; }
+    constexpr bool operator!=(TaskSet other) const { return bits_ != other.bits_; }
+
+    template <typename Func>
+    void for_each(Func func) const
+    {
+        for (uint32_t rest = bits_; rest != 0; rest &= rest - 1)
+            func(static_cast<TaskID>(__builtin_ctz(rest)));
+    }
+
+  private:
+    static_assert(kTaskCount <= 32, "TaskSet holds one bit per TaskID");
+
+    static constexpr uint32_t bit(TaskID id) { return uint32_t(1) << static_cast<size_t>(id); }
+    static constexpr TaskSet fromBits(uint32_t bits)
+    {
+        TaskSet set;
+        set.bits_ = bits;
+        return set;
+    }
+
+    uint32_t bits_ = 0;
+};
+
 inline const char* TaskIDToString(TaskID id)
 {
     switch (id) {
@@ -69,30 +141,360 @@ struct ErrorEvent {
 };
 
 struct CustomEvent {
-    std::string name;
+    EventName name;
     std::string payload;
 };
 
-using MailboxMessage = std::variant<SignalEvent, ErrorEvent, CustomEvent, std::string, int>;
+// Zero-copy payload: hands a pooled frame or audio chunk to other tasks.
+// Every receiver shares the same bytes; see BufferPool.
+struct BufferEvent {
+    BufferHandle buffer;
+};
+
+// One CustomEvent shared read-only by every subscriber it was published to.
+struct SharedEvent {
+    std::shared_ptr<const CustomEvent> event;
+};
+
+using MailboxMessage = std::variant<SignalEvent, ErrorEvent, CustomEvent, std::string, int, BufferEvent, SharedEvent>;
+
+// Dequeue lanes of the Queue backend. Auto derives the lane from the payload:
+// SignalEvent and ErrorEvent go to High, everything else to Normal. Low is
+// only used when a sender asks for it explicitly (bulk media traffic).
+enum class MailboxPriority : uint8_t { High = 0, Normal, Low, Auto };
+
+constexpr size_t kMailboxLanes = 3;
 
+// MailboxEnvelope::flags
+constexpr uint8_t kEnvelopeRequest = 0x01;  // answer with MailboxRpc::reply()
+constexpr uint8_t kEnvelopeAck = 0x02;      // acknowledge with MailboxAckTracker::ack()
+constexpr uint8_t kEnvelopeReplayed = 0x04; // sent by MailboxReplayer; never recorded again
+
+// Layout: a 16-byte header (ids, lane, flags, per-mailbox sequence number,
+// time-to-live, send timestamp, RPC correlation id) in front of the payload.
+// The payload type tag is the variant index. Small strings live inline
+// (SSO), event names are interned pointers, and bulk data travels out of
+// line in pooled BufferEvent blocks, so the whole envelope fits in one
+// 64-byte cache line.
 struct MailboxEnvelope {
-    TaskID sender;
-    TaskID receiver;
+    TaskID sender = TaskID::Unknown;
+    TaskID receiver = TaskID::Unknown;
+    MailboxPriority priority = MailboxPriority::Auto;
+    uint8_t flags = 0;        // kEnvelope* bits
+    uint16_t sequence = 0;    // assigned by the receiving mailbox on send, wraps
+    uint16_t ttl = 0;         // ms it may wait in a mailbox before it is dropped, 0: forever
+    uint32_t enqueued = 0;    // MailboxClockUs() at send, for wait-time stats and ttl
+    uint32_t correlation = 0; // MailboxRpc call id / MailboxAckTracker ticket
     MailboxMessage payload;
+
+    MailboxEnvelope() = default;
+
+    // Forwards args to the MailboxMessage constructor, so the payload is
+    // built directly in the envelope, e.g.
+    // MailboxEnvelope(from, to, std::in_place_type<CustomEvent>, name, data).
+    template <typename... Args>
+    MailboxEnvelope(TaskID from, TaskID to, Args&&... args) : sender(from), receiver(to), payload(std::forward<Args>(args)...)
+    {
+    }
+
+    // Sets ttl, clamped to 1 ms .. kMailboxMaxTtl. Expired envelopes are
+    // dropped at dequeue (and when a full Queue mailbox makes room) and
+    // counted in MailboxCounters::expired and per sender in g_mailboxStats.
+    void expire_after(std::chrono::milliseconds timeout);
+};
+
+constexpr std::chrono::milliseconds kMailboxMaxTtl(UINT16_MAX);
+
+enum class MailboxBackend {
+    Queue, // mutex-protected priority lanes, unbounded unless capacity is set
+    Ring,  // lock-free bounded MPSC ring, consumer parks only when empty; FIFO only
+};
+
+enum class MailboxDequeue {
+    Strict,   // always serve the highest non-empty lane
+    Weighted, // serve lanes in proportion to laneWeights so Low is never starved
+};
+
+// What send() does when the mailbox already holds capacity envelopes.
+enum class MailboxOverflow {
+    Block,      // wait up to blockTimeout for the consumer to make room
+    Reject,     // fail with MailboxStatus::Rejected
+    DropOldest, // discard the oldest pending envelope of the lowest non-empty lane
+    DropNewest, // discard the envelope being sent
+};
+
+// Latest-value mode for state-type traffic (network state, FPS, audio
+// level). A sent envelope whose key matches a pending one overwrites it in
+// place, keeping its queue position, so a slow consumer sees only the
+// newest value and the backlog is bounded by the number of keys. RPC
+// requests, acked envelopes, SignalEvent and ErrorEvent are never
+// coalesced, and an update only replaces a pending envelope in the same
+// lane and (under RoundRobin) from the same sender. Queue backend only.
+enum class MailboxCoalesce {
+    None,
+    ByName, // CustomEvent / SharedEvent keyed by event name; other payloads stay FIFO
+    ByKind, // as ByName, plus every other payload keyed by its type
 };
 
+// Order of envelopes from different senders within one lane. Queue
+// backend only.
+enum class MailboxFairness {
+    Fifo,       // one queue per lane, arrival order
+    RoundRobin, // one queue per sender per lane, served in turn, so a flooding
+                // sender delays others by at most one envelope per round
+};
+
+// Token bucket for one sender: up to burst envelopes at once, refilled at
+// rate per second. Sends beyond it fail with MailboxStatus::Throttled.
+struct MailboxRateLimit {
+    uint32_t rate = 0;  // envelopes per second, 0: unlimited
+    uint32_t burst = 0; // bucket size, 0: rate (one second's worth)
+};
+
+enum class MailboxStatus {
+    Ok,
+    Rejected,   // full, MailboxOverflow::Reject
+    Dropped,    // full, MailboxOverflow::DropNewest discarded this envelope
+    Timeout,    // full, MailboxOverflow::Block gave up after blockTimeout
+    NoReceiver, // MailboxRegistry could not route the envelope
+    Closed,     // the mailbox was closed
+    Throttled,  // the sender is over its MailboxConfig::senderLimits rate
+};
+
+const char* MailboxStatusToString(MailboxStatus status);
+
+constexpr std::chrono::milliseconds kMailboxWaitForever = std::chrono::milliseconds::max();
+
+struct MailboxConfig {
+    MailboxBackend backend = MailboxBackend::Queue;
+    // Maximum pending envelopes. Queue: 0 means unbounded. Ring: slots,
+    // rounded up to a power of two (0 selects kDefaultRingCapacity).
+    size_t capacity = 0;
+    MailboxDequeue dequeue = MailboxDequeue::Strict;
+    std::array<uint8_t, kMailboxLanes> laneWeights = {8, 4, 1};
+    MailboxOverflow overflow = MailboxOverflow::Block;
+    std::chrono::milliseconds blockTimeout = kMailboxWaitForever;
+    MailboxCoalesce coalesce = MailboxCoalesce::None;
+    MailboxFairness fairness = MailboxFairness::Fifo;
+    // Indexed by sender TaskID; Queue backend only.
+    std::array<MailboxRateLimit, kTaskCount> senderLimits{};
+    // Stamp envelopes on send and feed wait times into g_mailboxStats.
+    bool instrumented = true;
+    // Create an eventfd that becomes readable when envelopes arrive, so the
+    // owning task can wait on its mailbox and its I/O fds in one epoll_wait.
+    bool eventfd = false;
+};
+
+// Monotonic counters, for sizing capacity from field data.
+struct MailboxCounters {
+    uint64_t sent = 0;          // envelopes accepted into the mailbox
+    uint64_t received = 0;      // envelopes handed to the consumer
+    uint64_t droppedOldest = 0; // pending envelopes evicted by DropOldest
+    uint64_t droppedNewest = 0; // envelopes discarded by DropNewest
+    uint64_t rejected = 0;      // sends failed by Reject
+    uint64_t blocked = 0;       // sends that had to wait for room
+    uint64_t timedOut = 0;      // blocked sends that gave up
+    uint64_t coalesced = 0;     // sent envelopes that replaced a pending one
+    uint64_t expired = 0;       // envelopes dropped because their ttl ran out
+    uint64_t throttled = 0;     // sends refused by a sender rate limit
+};
+
+MailboxPriority MailboxLaneOf(const MailboxEnvelope& env);
+
+constexpr size_t kDefaultRingCapacity = 256;
+
+class MailboxRing;
+
 class Mailbox {
   public:
-    void send(const MailboxEnvelope& env);
-    MailboxEnvelope receive();
+    Mailbox();
+    ~Mailbox();
+
+    // Not thread-safe: call before the mailbox is shared between tasks.
+    void configure(const MailboxConfig& config);
+    const MailboxConfig& config() const;
+
+    MailboxStatus send(const MailboxEnvelope& env);
+    MailboxStatus send(MailboxEnvelope&& env);
+    // Builds the envelope in place from (sender, receiver, args...) and
+    // moves it into the mailbox; the payload is never copied.
+    template <typename... Args>
+    MailboxStatus emplace(TaskID sender, TaskID receiver, Args&&... args)
+    {
+        return send(MailboxEnvelope(sender, receiver, std::forward<Args>(args)...));
+    }
+    // As send(), but never waits: under MailboxOverflow::Block a full
+    // mailbox fails with MailboxStatus::Rejected (counted as rejected).
+    MailboxStatus try_send(MailboxEnvelope&& env);
+
+    using Clock = std::chrono::steady_clock;
+
+    // Envelopes are moved out of the mailbox, never copied. The blocking
+    // variants return std::nullopt once the mailbox is closed and empty;
+    // the timed ones also on timeout (check closed() to tell them apart).
+    std::optional<MailboxEnvelope> receive();
+    std::optional<MailboxEnvelope> receive_for(std::chrono::milliseconds timeout);
+    std::optional<MailboxEnvelope> receive_until(Clock::time_point deadline);
     std::optional<MailboxEnvelope> try_receive();
 
+    // Blocks until at least one envelope is pending, then appends up to
+    // max of them to out in one lock acquisition. Returns the count added,
+    // 0 once the mailbox is closed and empty (or the timeout expired).
+    size_t receive_batch(std::vector<MailboxEnvelope>& out, size_t max);
+    size_t receive_batch_for(std::vector<MailboxEnvelope>& out, size_t max, std::chrono::milliseconds timeout);
+    // Non-blocking: appends everything pending to out. Returns the count added.
+    size_t drain(std::vector<MailboxEnvelope>& out);
+
+    // End of stream: later sends fail with MailboxStatus::Closed, blocked
+    // producers and consumers wake up, and receivers get what is still
+    // pending followed by std::nullopt / 0.
+    void close();
+    bool closed() const;
+    // Undoes close() for a consumer that starts again: sends are accepted
+    // once more. Envelopes still pending from before are kept.
+    void reopen();
+
+    MailboxCounters counters() const;
+    size_t depth() const;
+    size_t high_watermark() const;
+
+    // eventfd readiness (MailboxConfig::eventfd), -1 when disabled. It is
+    // edge-triggered and coalesced: producers write it only on the first
+    // send after the consumer re-armed it with clear_readiness(), which
+    // reads the fd and then re-arms. Consumer loop: epoll_wait,
+    // clear_readiness(), then drain() until empty.
+    int readiness_fd() const;
+    void clear_readiness();
+
   private:
-    std::queue<MailboxEnvelope> queue_;
-    std::mutex mutex_;
+    struct AtomicCounters {
+        std::atomic<uint64_t> sent{0};
+        std::atomic<uint64_t> received{0};
+        std::atomic<uint64_t> droppedOldest{0};
+        std::atomic<uint64_t> droppedNewest{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> blocked{0};
+        std::atomic<uint64_t> timedOut{0};
+        std::atomic<uint64_t> coalesced{0};
+        std::atomic<uint64_t> expired{0};
+        std::atomic<uint64_t> throttled{0};
+    };
+
+    // One dequeue lane: queues[0] only under Fifo, one queue per sender
+    // under RoundRobin. Deque elements never move on push_back/pop_front,
+    // so the coalescing pointers into them stay valid.
+    struct Lane {
+        std::vector<std::deque<MailboxEnvelope>> queues = std::vector<std::deque<MailboxEnvelope>>(1);
+        size_t size = 0;
+        size_t next = 0; // RoundRobin: queue to serve next
+    };
+
+    struct TokenBucket {
+        double tokens = 0.0;
+        Clock::time_point refilled;
+    };
+
+    MailboxStatus push(MailboxEnvelope&& env, bool block);
+    MailboxStatus sendRing(MailboxEnvelope&& env, bool block);
+    bool waitForRoomLocked(std::unique_lock<std::mutex>& lock);
+    void dropOldestLocked();
+    bool coalesceKey(const MailboxEnvelope& env, uintptr_t& key) const;
+    bool coalesceLocked(MailboxEnvelope& env);
+    void popFrontLocked(size_t lane, size_t queue, MailboxEnvelope* out);
+    size_t nextQueueLocked(size_t lane);
+    bool throttleLocked(const MailboxEnvelope& env);
+    void resetLanes();
+    bool expiredAt(const MailboxEnvelope& env, uint32_t nowUs);
+    size_t purgeExpiredLocked();
+    void notifyProducersLocked();
+    void notifyConsumer();
+    bool waitForRing(Clock::time_point deadline);
+    void notifyRingProducers();
+    bool waitForRingRoom(Clock::time_point deadline);
+    bool waitPendingLocked(std::unique_lock<std::mutex>& lock, Clock::time_point deadline);
+    size_t receiveBatchUntil(std::vector<MailboxEnvelope>& out, size_t max, Clock::time_point deadline);
+    static Clock::time_point deadlineAfter(std::chrono::milliseconds timeout);
+    size_t popRing(std::vector<MailboxEnvelope>& out, size_t max);
+    size_t popQueue(std::vector<MailboxEnvelope>& out, size_t max);
+    void pushLocked(MailboxEnvelope&& env);
+    bool popLocked(MailboxEnvelope& out, uint32_t nowUs);
+    uint32_t dequeueClock() const;
+    void onDequeued(const MailboxEnvelope& env, uint32_t nowUs);
+    void noteDepth(size_t depth);
+    void signalReadiness();
+    size_t nextLaneLocked();
+
+    MailboxConfig config_;
+    std::array<Lane, kMailboxLanes> lanes_;
+    std::array<TokenBucket, kTaskCount> buckets_;
+    std::array<uint8_t, kMailboxLanes> laneCredits_{};
+    size_t pending_ = 0;
+    bool ttlPending_ = false; // some pending envelope may have a ttl
+    // Coalescing: key -> the pending envelope holding it. Deque references
+    // stay valid across push_back/pop_front, so the pointers are stable.
+    std::unordered_map<uintptr_t, MailboxEnvelope*> latest_;
+    size_t blockedProducers_ = 0;
+    std::unique_ptr<MailboxRing> ring_;
+    std::atomic<bool> consumerWaiting_{false};
+    std::atomic<uint32_t> ringProducersWaiting_{0}; // parked in waitForRingRoom()
+    std::atomic<bool> closed_{false};
+    std::atomic<uint32_t> nextSequence_{0};
+    std::atomic<size_t> highWatermark_{0};
+    int eventFd_ = -1;
+    std::atomic<bool> readinessSignaled_{false};
+    AtomicCounters counters_;
+    mutable std::mutex mutex_;
     std::condition_variable cond_;
+    std::condition_variable notFull_;
+};
+
+class MailboxRecorder;
+
+// One mailbox per TaskID. send() routes on env.receiver so each task only
+// contends with its own producers and waits on its own condition variable.
+class MailboxRegistry {
+  public:
+    Mailbox& get(TaskID id);
+    void configure(TaskID id, const MailboxConfig& config);
+    void close_all();
+    // Every envelope send() routes to a valid receiver is also handed to
+    // recorder (nullptr to stop), except replayed ones (kEnvelopeReplayed).
+    // The recorder must outlive its registration.
+    void set_recorder(MailboxRecorder* recorder);
+    // Calls activate once, on the thread of the first send() or multicast()
+    // to id after this call and before that envelope is queued, so a task
+    // can be started only when something needs it. nullptr disarms.
+    void on_demand(TaskID id, std::function<void()> activate);
+    MailboxStatus send(const MailboxEnvelope& env);
+    MailboxStatus send(MailboxEnvelope&& env);
+    template <typename... Args>
+    MailboxStatus emplace(TaskID sender, TaskID receiver, Args&&... args)
+    {
+        return send(MailboxEnvelope(sender, receiver, std::forward<Args>(args)...));
+    }
+    // Mailbox::try_send() on the mailbox of env.receiver.
+    MailboxStatus try_send(MailboxEnvelope&& env);
+
+    // Sends env to every task in receivers (env.receiver is ignored) and
+    // returns the ones that accepted it. A CustomEvent payload is wrapped in
+    // one SharedEvent first, so like BufferEvent and SharedEvent it costs a
+    // reference count per receiver instead of a copy. ErrorEvent and
+    // std::string payloads are not: SharedEvent holds only a CustomEvent, so
+    // they are copied per receiver. Send long text as a CustomEvent.
+    TaskSet multicast(MailboxEnvelope env, TaskSet receivers);
+    TaskSet multicast(TaskID sender, TaskSet receivers, MailboxMessage payload);
+
+  private:
+    Mailbox* route(const MailboxEnvelope& env);
+    void demand(size_t index);
+
+    std::array<Mailbox, kTaskCount> mailboxes_;
+    std::atomic<MailboxRecorder*> recorder_{nullptr};
+    std::array<std::atomic<bool>, kTaskCount> demandArmed_{};
+    std::array<std::function<void()>, kTaskCount> demand_;
+    std::mutex demandMutex_;
 };
 
-extern Mailbox g_mailbox;
+extern MailboxRegistry g_mailboxes;
 
 } // namespace AIOTEK
@@ -0,0 +1,83 @@
+#include "aiotek_mailbox_ack.hpp"
+#include "aiotek_log.hpp"
+
+namespace AIOTEK {
+
+MailboxAckTracker::MailboxAckTracker(MailboxRegistry& registry) : registry_(registry)
+{
+}
+
+MailboxAckTicket MailboxAckTracker::broadcast(TaskID sender, TaskSet receivers, MailboxMessage payload)
+{
+    MailboxAckTicket ticket;
+    if (receivers.empty())
+        return ticket;
+    {
+        // Register before sending: a receiver may ack before multicast returns.
+        std::lock_guard<std::mutex> lock(mutex_);
+        ticket.id = nextTicket_++;
+        if (nextTicket_ == 0)
+            nextTicket_ = 1;
+        pending_[ticket.id] = receivers;
+    }
+
+    MailboxEnvelope env(sender, TaskID::Unknown, std::move(payload));
+    env.flags |= kEnvelopeAck;
+    env.correlation = ticket.id;
+    ticket.delivered = registry_.multicast(std::move(env), receivers);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_.find(ticket.id);
+    it->second = it->second - (receivers - ticket.delivered);
+    if (ticket.delivered.empty()) {
+        pending_.erase(it);
+        ticket.id = 0;
+    }
+    return ticket;
+}
+
+bool MailboxAckTracker::ack(const MailboxEnvelope& env)
+{
+    if (!(env.flags & kEnvelopeAck))
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pending_.find(env.correlation);
+        if (it == pending_.end() || !it->second.contains(env.receiver))
+            return false;
+        it->second.remove(env.receiver);
+    }
+    acked_.notify_all();
+    return true;
+}
+
+TaskSet MailboxAckTracker::wait(const MailboxAckTicket& ticket, std::chrono::milliseconds timeout)
+{
+    if (ticket.id == 0)
+        return TaskSet();
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = pending_.find(ticket.id);
+    if (it == pending_.end())
+        return TaskSet();
+    const TaskSet& remaining = it->second; // stays valid across rehashing
+    acked_.wait_for(lock, timeout, [&] { return remaining.empty(); });
+    TaskSet missing = remaining;
+    pending_.erase(ticket.id);
+    if (!missing.empty()) {
+        std::string names;
+        missing.for_each([&](TaskID id) { names += std::string(names.empty() ? "" : ", ") + TaskIDToString(id); });
+        AIOTEK_LOG_WARNING("MailboxAckTracker: No ack from " + names);
+    }
+    return missing;
+}
+
+TaskSet MailboxAckTracker::outstanding(const MailboxAckTicket& ticket) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_.find(ticket.id);
+    return it == pending_.end() ? TaskSet() : it->second;
+}
+
+MailboxAckTracker g_acks(g_mailboxes);
+
+} // namespace AIOTEK
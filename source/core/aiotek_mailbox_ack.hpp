@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include "aiotek_mailbox.hpp"
+
+namespace AIOTEK {
+
+struct MailboxAckTicket {
+    uint32_t id = 0;   // 0: nothing was delivered, nothing to wait for
+    TaskSet delivered; // receivers whose mailbox accepted the envelope
+};
+
+// Multicast with per-receiver acknowledgement, for notifications the sender
+// has to see handled (shutdown, config reload). broadcast() multicasts the
+// payload flagged kEnvelopeAck with a ticket id in `correlation`; each
+// receiver calls ack(env) once it has acted on it, and the sender blocks in
+// wait() until every receiver that accepted the envelope has done so.
+//
+//   auto ticket = g_acks.broadcast(TaskID::Managers, tasks, SignalEvent{0});
+//   TaskSet missing = g_acks.wait(ticket, std::chrono::milliseconds(500));
+class MailboxAckTracker {
+  public:
+    explicit MailboxAckTracker(MailboxRegistry& registry);
+
+    MailboxAckTicket broadcast(TaskID sender, TaskSet receivers, MailboxMessage payload);
+
+    // Returns false if env does not ask for an ack or its ticket is gone.
+    bool ack(const MailboxEnvelope& env);
+
+    // Waits for the ticket's receivers and forgets the ticket. Returns the
+    // receivers that did not ack in time (empty: all did).
+    TaskSet wait(const MailboxAckTicket& ticket, std::chrono::milliseconds timeout);
+
+    // Receivers that have not acked yet.
+    TaskSet outstanding(const MailboxAckTicket& ticket) const;
+
+  private:
+    MailboxRegistry& registry_;
+    uint32_t nextTicket_ = 1;
+    mutable std::mutex mutex_;
+    std::condition_variable acked_;
+    std::unordered_map<uint32_t, TaskSet> pending_; // ticket -> not yet acked
+};
+
+extern MailboxAckTracker g_acks;
+
+} // namespace AIOTEK
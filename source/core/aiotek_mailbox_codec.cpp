@@ -0,0 +1,296 @@
+#include <cstring>
+#include "aiotek_mailbox_codec.hpp"
+
+namespace AIOTEK {
+
+namespace {
+
+class WireWriter {
+  public:
+    explicit WireWriter(uint8_t* dst) : pos_(dst) {}
+
+    void u8(uint8_t value) { *pos_++ = value; }
+
+    void u16(uint16_t value)
+    {
+        u8(static_cast<uint8_t>(value));
+        u8(static_cast<uint8_t>(value >> 8));
+    }
+
+    void u32(uint32_t value)
+    {
+        u16(static_cast<uint16_t>(value));
+        u16(static_cast<uint16_t>(value >> 16));
+    }
+
+    void u64(uint64_t value)
+    {
+        u32(static_cast<uint32_t>(value));
+        u32(static_cast<uint32_t>(value >> 32));
+    }
+
+    void bytes(const void* data, size_t size)
+    {
+        if (size)
+            std::memcpy(pos_, data, size);
+        pos_ += size;
+    }
+
+    void string(const char* data, size_t size)
+    {
+        u32(static_cast<uint32_t>(size));
+        bytes(data, size);
+    }
+
+  private:
+    uint8_t* pos_;
+};
+
+class WireReader {
+  public:
+    WireReader(const uint8_t* data, size_t size) : pos_(data), end_(data + size) {}
+
+    bool ok() const { return ok_; }
+    bool atEnd() const { return ok_ && pos_ == end_; }
+
+    uint8_t u8()
+    {
+        if (!need(1))
+            return 0;
+        return *pos_++;
+    }
+
+    uint16_t u16()
+    {
+        uint16_t low = u8();
+        return static_cast<uint16_t>(low | (u8() << 8));
+    }
+
+    uint32_t u32()
+    {
+        uint32_t low = u16();
+        return low | (static_cast<uint32_t>(u16()) << 16);
+    }
+
+    uint64_t u64()
+    {
+        uint64_t low = u32();
+        return low | (static_cast<uint64_t>(u32()) << 32);
+    }
+
+    const uint8_t* bytes(size_t size)
+    {
+        if (!need(size))
+            return nullptr;
+        const uint8_t* start = pos_;
+        pos_ += size;
+        return start;
+    }
+
+    std::string string()
+    {
+        uint32_t size = u32();
+        const uint8_t* data = bytes(size);
+        return data ? std::string(reinterpret_cast<const char*>(data), size) : std::string();
+    }
+
+  private:
+    bool need(size_t size)
+    {
+        if (!ok_ || static_cast<size_t>(end_ - pos_) < size)
+            ok_ = false;
+        return ok_;
+    }
+
+    const uint8_t* pos_;
+    const uint8_t* end_;
+    bool ok_ = true;
+};
+
+constexpr size_t kBufferInfoWireSize = 1 + 1 + 2 + 4 * 4 + 8;
+
+// Payload visitor shared by sizing and encoding, so the two cannot drift.
+template <typename Sink>
+void encodePayload(const MailboxMessage& payload, Sink& sink)
+{
+    std::visit([&sink](const auto& value) {
+        using T = std::decay_t<decltype(value)>;
+        if constexpr (std::is_same_v<T, SignalEvent>) {
+            sink.type(MailboxWireType::Signal);
+            sink.u32(static_cast<uint32_t>(value.signal));
+        } else if constexpr (std::is_same_v<T, ErrorEvent>) {
+            sink.type(MailboxWireType::Error);
+            sink.u32(static_cast<uint32_t>(value.code));
+            sink.string(value.message.data(), value.message.size());
+        } else if constexpr (std::is_same_v<T, CustomEvent>) {
+            sink.type(MailboxWireType::Custom);
+            sink.string(value.name.c_str(), value.name.str().size());
+            sink.string(value.payload.data(), value.payload.size());
+        } else if constexpr (std::is_same_v<T, SharedEvent>) {
+            sink.type(MailboxWireType::Custom);
+            static const CustomEvent empty{};
+            const CustomEvent& event = value.event ? *value.event : empty;
+            sink.string(event.name.c_str(), event.name.str().size());
+            sink.string(event.payload.data(), event.payload.size());
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            sink.type(MailboxWireType::String);
+            sink.string(value.data(), value.size());
+        } else if constexpr (std::is_same_v<T, int>) {
+            sink.type(MailboxWireType::Int);
+            sink.u32(static_cast<uint32_t>(value));
+        } else if constexpr (std::is_same_v<T, BufferEvent>) {
+            sink.type(MailboxWireType::Buffer);
+            static const BufferInfo none{};
+            const BufferInfo& info = value.buffer ? value.buffer.info() : none;
+            sink.u8(static_cast<uint8_t>(info.format));
+            sink.u8(0);
+            sink.u16(info.channels);
+            sink.u32(info.width);
+            sink.u32(info.height);
+            sink.u32(info.stride);
+            sink.u32(info.sampleRate);
+            sink.u64(info.timestamp);
+            sink.string(reinterpret_cast<const char*>(value.buffer.data()), value.buffer ? value.buffer.size() : 0);
+        }
+    }, payload);
+}
+
+struct SizeSink {
+    size_t size = 0;
+    uint8_t type_ = 0;
+
+    void type(MailboxWireType wireType) { type_ = static_cast<uint8_t>(wireType); }
+    void u8(uint8_t) { size += 1; }
+    void u16(uint16_t) { size += 2; }
+    void u32(uint32_t) { size += 4; }
+    void u64(uint64_t) { size += 8; }
+    void string(const char*, size_t length) { size += 4 + length; }
+};
+
+struct WriteSink : WireWriter {
+    using WireWriter::WireWriter;
+    void type(MailboxWireType) {}
+};
+
+bool decodePayload(MailboxWireType type, WireReader& in, MailboxMessage& payload, BufferPool* pool)
+{
+    switch (type) {
+        case MailboxWireType::Signal:
+            payload.emplace<SignalEvent>(SignalEvent{static_cast<int32_t>(in.u32())});
+            return true;
+        case MailboxWireType::Error: {
+            auto code = static_cast<int32_t>(in.u32());
+            payload.emplace<ErrorEvent>(ErrorEvent{code, in.string()});
+            return true;
+        }
+        case MailboxWireType::Custom: {
+            std::string name = in.string();
+            payload.emplace<CustomEvent>(CustomEvent{EventName(name), in.string()});
+            return true;
+        }
+        case MailboxWireType::String:
+            payload.emplace<std::string>(in.string());
+            return true;
+        case MailboxWireType::Int:
+            payload.emplace<int>(static_cast<int32_t>(in.u32()));
+            return true;
+        case MailboxWireType::Buffer: {
+            BufferInfo info;
+            info.format = static_cast<BufferFormat>(in.u8());
+            in.u8();
+            info.channels = in.u16();
+            info.width = in.u32();
+            info.height = in.u32();
+            info.stride = in.u32();
+            info.sampleRate = in.u32();
+            info.timestamp = in.u64();
+            uint32_t size = in.u32();
+            const uint8_t* data = in.bytes(size);
+            if (!data || !pool)
+                return false;
+            MutableBuffer buffer = pool->acquire();
+            if (!buffer || buffer.capacity() < size)
+                return false;
+            std::memcpy(buffer.data(), data, size);
+            buffer.setSize(size);
+            buffer.info() = info;
+            payload.emplace<BufferEvent>(BufferEvent{std::move(buffer).publish()});
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+static_assert(kBufferInfoWireSize == 28, "Buffer wire header is part of the format");
+
+size_t MailboxEncodedSize(const MailboxEnvelope& env)
+{
+    SizeSink sink;
+    encodePayload(env.payload, sink);
+    return kMailboxWireHeaderSize + sink.size;
+}
+
+size_t MailboxEncodeTo(const MailboxEnvelope& env, uint8_t* dst, size_t capacity)
+{
+    SizeSink sizer;
+    encodePayload(env.payload, sizer);
+    size_t size = kMailboxWireHeaderSize + sizer.size;
+    if (size > capacity)
+        return 0;
+
+    WriteSink out(dst);
+    out.u8(kMailboxCodecVersion);
+    out.u8(static_cast<uint8_t>(env.sender));
+    out.u8(static_cast<uint8_t>(env.receiver));
+    out.u8(static_cast<uint8_t>(env.priority));
+    out.u8(sizer.type_);
+    out.u8(env.flags);
+    out.u16(env.ttl);
+    out.u32(env.sequence);
+    out.u32(env.enqueued);
+    out.u32(env.correlation);
+    encodePayload(env.payload, out);
+    return size;
+}
+
+void MailboxWireStamp(uint8_t* encoded, uint32_t sequence, uint32_t enqueued)
+{
+    WireWriter out(encoded + 8);
+    out.u32(sequence);
+    out.u32(enqueued);
+}
+
+void MailboxEncode(const MailboxEnvelope& env, std::vector<uint8_t>& out)
+{
+    size_t offset = out.size();
+    size_t size = MailboxEncodedSize(env);
+    out.resize(offset + size);
+    MailboxEncodeTo(env, out.data() + offset, size);
+}
+
+bool MailboxDecode(const uint8_t* data, size_t size, MailboxEnvelope& out, BufferPool* pool)
+{
+    WireReader in(data, size);
+    if (in.u8() != kMailboxCodecVersion)
+        return false;
+    uint8_t sender = in.u8();
+    uint8_t receiver = in.u8();
+    uint8_t priority = in.u8();
+    auto type = static_cast<MailboxWireType>(in.u8());
+    uint8_t flags = in.u8();
+    out.ttl = in.u16();
+    out.sequence = static_cast<uint16_t>(in.u32());
+    out.enqueued = in.u32();
+    out.correlation = in.u32();
+    if (!in.ok() || sender >= kTaskCount || receiver >= kTaskCount || priority > static_cast<uint8_t>(MailboxPriority::Auto))
+        return false;
+    out.sender = static_cast<TaskID>(sender);
+    out.receiver = static_cast<TaskID>(receiver);
+    out.priority = static_cast<MailboxPriority>(priority);
+    out.flags = flags;
+    return decodePayload(type, in, out.payload, pool) && in.atEnd();
+}
+
+} // namespace AIOTEK
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "aiotek_mailbox.hpp"
+
+namespace AIOTEK {
+
+// Stable binary encoding of a MailboxEnvelope, for carrying envelopes
+// between processes or to disk. All integers are little-endian; the layout
+// does not depend on the compiler, the architecture or the order of the
+// MailboxMessage variant.
+//
+//   offset  size  field
+//   0       1     version (kMailboxCodecVersion)
+//   1       1     sender
+//   2       1     receiver
+//   3       1     priority
+//   4       1     payload type (MailboxWireType)
+//   5       1     flags (kEnvelopeRequest, kEnvelopeAck, kEnvelopeReplayed)
+//   6       2     ttl (ms it may wait in a mailbox, 0: forever)
+//   8       4     sequence (the in-memory envelope keeps the low 16 bits)
+//   12      4     enqueued
+//   16      4     correlation (MailboxRpc call id / ack ticket, 0: none)
+//   20      ...   payload body
+//
+// Payload bodies:
+//   Signal   i32 signal
+//   Error    i32 code, u32 length, message bytes
+//   Custom   u32 length, name bytes, u32 length, payload bytes
+//   String   u32 length, bytes
+//   Int      i32 value
+//   Buffer   u8 format, u8 pad, u16 channels, u32 width, u32 height,
+//            u32 stride, u32 sampleRate, u64 timestamp, u32 size, bytes
+//
+// SharedEvent is encoded as a Custom payload; the sharing is a property of
+// one process and does not survive the trip.
+constexpr uint8_t kMailboxCodecVersion = 1;
+constexpr size_t kMailboxWireHeaderSize = 20;
+
+enum class MailboxWireType : uint8_t {
+    Signal = 1,
+    Error = 2,
+    Custom = 3,
+    String = 4,
+    Int = 5,
+    Buffer = 6,
+};
+
+// Exact number of bytes MailboxEncodeTo() writes for env.
+size_t MailboxEncodedSize(const MailboxEnvelope& env);
+
+// Writes env to dst. Returns the number of bytes written, or 0 if it does
+// not fit in capacity bytes.
+size_t MailboxEncodeTo(const MailboxEnvelope& env, uint8_t* dst, size_t capacity);
+
+// Overwrites the sequence and enqueued fields of an encoded envelope in
+// place, for transports that assign them after encoding.
+void MailboxWireStamp(uint8_t* encoded, uint32_t sequence, uint32_t enqueued);
+
+// Appends the encoding of env to out.
+void MailboxEncode(const MailboxEnvelope& env, std::vector<uint8_t>& out);
+
+// Decodes one envelope from data. Buffer payloads are copied into a block
+// acquired from pool; without a pool, or when it is exhausted or its blocks
+// are too small, decoding a Buffer payload fails. Returns false on any
+// malformed or truncated input, or a version other than
+// kMailboxCodecVersion, leaving out unspecified.
+bool MailboxDecode(const uint8_t* data, size_t size, MailboxEnvelope& out, BufferPool* pool = nullptr);
+
+} // namespace AIOTEK
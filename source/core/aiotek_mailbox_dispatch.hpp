@@ -0,0 +1,93 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include "aiotek_mailbox.hpp"
+
+namespace AIOTEK {
+
+// Combines per-message handler types into one overload set, so a task can
+// build its handler from a list of small structs:
+//
+//   struct OnSignal { void operator()(const MailboxEnvelope&, const SignalEvent&) const; };
+//   struct OnText   { void operator()(const MailboxEnvelope&, const std::string&) const; };
+//   using ReceiverHandlers = MailboxHandlers<OnSignal, OnText, MailboxIgnore<int, BufferEvent>, ...>;
+template <typename... Handlers>
+struct MailboxHandlers : Handlers... {
+    using Handlers::operator()...;
+};
+
+// Explicitly drops the listed payload types. Use it instead of a catch-all
+// template so that a newly added payload type still fails to compile.
+template <typename... Ts>
+struct MailboxIgnore {
+    template <typename T, typename = std::enable_if_t<(std::is_same_v<T, Ts> || ...)>>
+    void operator()(const MailboxEnvelope&, const T&) const
+    {
+    }
+};
+
+namespace detail {
+
+template <typename Handler, typename T>
+constexpr bool kHandles = std::is_invocable_v<Handler&, const MailboxEnvelope&, const T&>;
+
+// Instantiated once per payload type so the compiler names the missing one.
+template <typename Handler, typename T>
+struct RequireHandler {
+    static_assert(kHandles<Handler, T>, "mailbox handler set does not handle payload type T; add an overload or list T in MailboxIgnore");
+    static constexpr bool value = kHandles<Handler, T>;
+};
+
+template <typename Handler, typename Variant>
+struct RequireAllHandlers;
+
+template <typename Handler, typename... Ts>
+struct RequireAllHandlers<Handler, std::variant<Ts...>> {
+    static constexpr bool value = (RequireHandler<Handler, Ts>::value && ...);
+};
+
+} // namespace detail
+
+// Dispatches an envelope to Handler through a table of function pointers
+// indexed by the payload's variant index: one indirect call, no chain of
+// type tests, and every MailboxMessage alternative must be handled at
+// compile time.
+template <typename Handler>
+class MailboxDispatcher {
+  public:
+    static_assert(detail::RequireAllHandlers<Handler, MailboxMessage>::value, "incomplete mailbox handler set");
+
+    explicit MailboxDispatcher(Handler& handler) : handler_(handler) {}
+
+    void operator()(const MailboxEnvelope& env) const
+    {
+        if (env.payload.valueless_by_exception())
+            return;
+        kTable[env.payload.index()](handler_, env);
+    }
+
+  private:
+    using Thunk = void (*)(Handler&, const MailboxEnvelope&);
+
+    template <size_t I>
+    static void invoke(Handler& handler, const MailboxEnvelope& env)
+    {
+        handler(env, *std::get_if<I>(&env.payload));
+    }
+
+    template <size_t... Is>
+    static constexpr std::array<Thunk, sizeof...(Is)> makeTable(std::index_sequence<Is...>)
+    {
+        return {{&invoke<Is>...}};
+    }
+
+    static constexpr std::array<Thunk, std::variant_size_v<MailboxMessage>> kTable =
+        makeTable(std::make_index_sequence<std::variant_size_v<MailboxMessage>>());
+
+    Handler& handler_;
+};
+
+} // namespace AIOTEK
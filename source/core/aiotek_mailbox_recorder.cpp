@@ -0,0 +1,213 @@
+#include <cstring>
+#include <thread>
+#include "aiotek_mailbox_recorder.hpp"
+#include "aiotek_mailbox_codec.hpp"
+#include "aiotek_log.hpp"
+
+namespace AIOTEK {
+
+static const char kLogMagic[8] = {'A', 'I', 'O', 'T', 'E', 'K', 'M', 'L'};
+static constexpr size_t kLogHeaderSize = 16;
+static constexpr size_t kMaxVarintSize = 10;
+// Anything larger is treated as a corrupt length rather than allocated.
+static constexpr uint64_t kMaxRecordSize = 64u << 20;
+
+static size_t putVarint(uint8_t* out, uint64_t value)
+{
+    size_t size = 0;
+    while (value >= 0x80) {
+        out[size++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+static size_t varintSize(uint64_t value)
+{
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+MailboxRecorder::~MailboxRecorder()
+{
+    stop();
+}
+
+bool MailboxRecorder::start(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_)
+        std::fclose(file_);
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        AIOTEK_LOG_ERROR("MailboxRecorder: cannot open " + path);
+        return false;
+    }
+    uint8_t header[kLogHeaderSize] = {};
+    std::memcpy(header, kLogMagic, sizeof(kLogMagic));
+    header[8] = kMailboxLogVersion;
+    std::fwrite(header, 1, sizeof(header), file_);
+    last_ = std::chrono::steady_clock::now();
+    records_ = 0;
+    bytes_ = sizeof(header);
+    return true;
+}
+
+void MailboxRecorder::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_)
+        std::fclose(file_);
+    file_ = nullptr;
+}
+
+bool MailboxRecorder::recording() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return file_ != nullptr;
+}
+
+void MailboxRecorder::record(const MailboxEnvelope& env)
+{
+    size_t encodedSize = MailboxEncodedSize(env);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_)
+        return;
+    // Stamp under the lock so gaps are never negative in file order.
+    auto now = std::chrono::steady_clock::now();
+    auto gap = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - last_).count());
+    last_ = now;
+
+    size_t bodySize = varintSize(gap) + encodedSize;
+    scratch_.resize(kMaxVarintSize + bodySize);
+    size_t size = putVarint(scratch_.data(), bodySize);
+    size += putVarint(scratch_.data() + size, gap);
+    size += MailboxEncodeTo(env, scratch_.data() + size, encodedSize);
+    std::fwrite(scratch_.data(), 1, size, file_);
+    ++records_;
+    bytes_ += size;
+}
+
+void MailboxRecorder::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_)
+        std::fflush(file_);
+}
+
+uint64_t MailboxRecorder::records() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+}
+
+uint64_t MailboxRecorder::bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+MailboxReplayer::~MailboxReplayer()
+{
+    close();
+}
+
+bool MailboxReplayer::open(const std::string& path, BufferPool* bufferPool)
+{
+    close();
+    bufferPool_ = bufferPool;
+    file_ = std::fopen(path.c_str(), "rb");
+    if (!file_) {
+        AIOTEK_LOG_ERROR("MailboxReplayer: cannot open " + path);
+        return false;
+    }
+    uint8_t header[kLogHeaderSize];
+    if (std::fread(header, 1, sizeof(header), file_) != sizeof(header) || std::memcmp(header, kLogMagic, sizeof(kLogMagic)) != 0
+        || header[8] != kMailboxLogVersion) {
+        AIOTEK_LOG_ERROR("MailboxReplayer: " + path + " is not a mailbox traffic log");
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MailboxReplayer::close()
+{
+    if (file_)
+        std::fclose(file_);
+    file_ = nullptr;
+}
+
+bool MailboxReplayer::readVarint(uint64_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int byte = std::fgetc(file_);
+        if (byte == EOF)
+            return false;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool MailboxReplayer::next(MailboxEnvelope& env, std::chrono::microseconds& gap, bool& corrupt)
+{
+    corrupt = false;
+    uint64_t bodySize;
+    if (!file_ || !readVarint(bodySize) || bodySize == 0 || bodySize > kMaxRecordSize)
+        return false;
+    scratch_.resize(bodySize);
+    if (std::fread(scratch_.data(), 1, bodySize, file_) != bodySize)
+        return false; // truncated tail, e.g. the recorder was not stopped
+
+    uint64_t gapUs = 0;
+    size_t offset = 0;
+    for (unsigned shift = 0; offset < bodySize && shift < 64; shift += 7) {
+        uint8_t byte = scratch_[offset++];
+        gapUs |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+    gap = std::chrono::microseconds(gapUs);
+    corrupt = !MailboxDecode(scratch_.data() + offset, bodySize - offset, env, bufferPool_);
+    return true;
+}
+
+MailboxReplayResult MailboxReplayer::replay(MailboxRegistry& registry, MailboxReplayMode mode, double speed)
+{
+    MailboxReplayResult result;
+    auto start = std::chrono::steady_clock::now();
+    auto due = start;
+    MailboxEnvelope env;
+    std::chrono::microseconds gap;
+    bool corrupt;
+    while (next(env, gap, corrupt)) {
+        if (mode == MailboxReplayMode::Timed) {
+            due += std::chrono::duration_cast<std::chrono::steady_clock::duration>(gap / (speed > 0 ? speed : 1.0));
+            std::this_thread::sleep_until(due);
+        }
+        if (corrupt) {
+            ++result.corrupt;
+            continue;
+        }
+        // Call ids and ack tickets belong to the recording process; here
+        // they could match a live call or ticket.
+        env.flags = static_cast<uint8_t>((env.flags & ~(kEnvelopeRequest | kEnvelopeAck)) | kEnvelopeReplayed);
+        env.correlation = 0;
+        if (registry.send(std::move(env)) == MailboxStatus::Ok)
+            ++result.replayed;
+        else
+            ++result.failed;
+    }
+    result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    return result;
+}
+
+} // namespace AIOTEK
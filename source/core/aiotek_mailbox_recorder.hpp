@@ -0,0 +1,97 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "aiotek_mailbox.hpp"
+
+namespace AIOTEK {
+
+// Traffic log file layout:
+//   file header   8 bytes "AIOTEKML", u8 format version, 7 bytes zero
+//   per record    varint length of the rest of the record
+//                 varint microseconds since the previous record
+//                 MailboxCodec encoding of the envelope
+// Varints are LEB128 (7 bits per byte, low bits first), so a small text
+// message sent a few milliseconds after the previous one costs ~25 bytes.
+constexpr uint8_t kMailboxLogVersion = 1;
+
+// Appends every envelope routed through a MailboxRegistry to a traffic log
+// (see MailboxRegistry::set_recorder). record() is thread-safe; writes go
+// through a stdio buffer, so flush() or stop() before reading the file.
+class MailboxRecorder {
+  public:
+    MailboxRecorder() = default;
+    ~MailboxRecorder();
+    MailboxRecorder(const MailboxRecorder&) = delete;
+    MailboxRecorder& operator=(const MailboxRecorder&) = delete;
+
+    bool start(const std::string& path);
+    void stop();
+    bool recording() const;
+
+    void record(const MailboxEnvelope& env);
+    void flush();
+
+    uint64_t records() const;
+    uint64_t bytes() const;
+
+  private:
+    mutable std::mutex mutex_;
+    FILE* file_ = nullptr;
+    std::vector<uint8_t> scratch_;
+    std::chrono::steady_clock::time_point last_;
+    uint64_t records_ = 0;
+    uint64_t bytes_ = 0;
+};
+
+enum class MailboxReplayMode {
+    Timed,       // keep the recorded gaps between envelopes
+    AsFastAsPossible,
+};
+
+struct MailboxReplayResult {
+    uint64_t replayed = 0; // envelopes accepted by their mailbox
+    uint64_t failed = 0;   // envelopes a mailbox refused (see MailboxStatus)
+    uint64_t corrupt = 0;  // records that could not be decoded
+    std::chrono::microseconds elapsed{0};
+};
+
+// Reads a traffic log back and sends it into a registry. The envelopes keep
+// their recorded sender, receiver, priority and payload; sequence numbers
+// and send stamps are assigned afresh by the receiving mailboxes. They are
+// flagged kEnvelopeReplayed, so a recorder left running does not log them
+// a second time, and lose kEnvelopeRequest, kEnvelopeAck and their
+// correlation id, so they cannot answer or ack a call of this process.
+class MailboxReplayer {
+  public:
+    MailboxReplayer() = default;
+    ~MailboxReplayer();
+    MailboxReplayer(const MailboxReplayer&) = delete;
+    MailboxReplayer& operator=(const MailboxReplayer&) = delete;
+
+    // bufferPool receives the bytes of recorded BufferEvents; without it
+    // those records count as corrupt.
+    bool open(const std::string& path, BufferPool* bufferPool = nullptr);
+    void close();
+
+    // Reads the next record. gap is the time since the previous record.
+    // Returns false at end of file; corrupt is set when a record was
+    // skipped because it could not be decoded.
+    bool next(MailboxEnvelope& env, std::chrono::microseconds& gap, bool& corrupt);
+
+    // Sends every remaining record into registry. speed scales the recorded
+    // gaps in Timed mode (2.0 replays twice as fast).
+    MailboxReplayResult replay(MailboxRegistry& registry, MailboxReplayMode mode, double speed = 1.0);
+
+  private:
+    bool readVarint(uint64_t& value);
+
+    FILE* file_ = nullptr;
+    BufferPool* bufferPool_ = nullptr;
+    std::vector<uint8_t> scratch_;
+};
+
+} // namespace AIOTEK
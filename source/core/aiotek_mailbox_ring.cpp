@@ -0,0 +1,79 @@
+#include "aiotek_mailbox_ring.hpp"
+
+namespace AIOTEK {
+
+static size_t roundUpPowerOfTwo(size_t value)
+{
+    size_t result = 2;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+MailboxRing::MailboxRing(size_t capacity)
+    : cells_(new Cell[roundUpPowerOfTwo(capacity)]), mask_(roundUpPowerOfTwo(capacity) - 1), enqueuePos_(0), dequeuePos_(0)
+{
+    for (size_t i = 0; i <= mask_; ++i)
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool MailboxRing::try_push(MailboxEnvelope&& env)
+{
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells_[pos & mask_];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+            if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.env = std::move(env);
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool MailboxRing::try_pop(MailboxEnvelope& out)
+{
+    size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells_[pos & mask_];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+        if (diff == 0) {
+            if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                out = std::move(cell.env);
+                cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // empty
+        } else {
+            pos = dequeuePos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+size_t MailboxRing::capacity() const
+{
+    return mask_ + 1;
+}
+
+bool MailboxRing::empty() const
+{
+    return enqueuePos_.load(std::memory_order_acquire) == dequeuePos_.load(std::memory_order_acquire);
+}
+
+size_t MailboxRing::size() const
+{
+    size_t dequeued = dequeuePos_.load(std::memory_order_acquire);
+    size_t enqueued = enqueuePos_.load(std::memory_order_acquire);
+    return enqueued >= dequeued ? enqueued - dequeued : 0;
+}
+
+} // namespace AIOTEK
@@ -0,0 +1,37 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include "aiotek_mailbox.hpp"
+
+namespace AIOTEK {
+
+// Bounded lock-free ring of envelopes (Vyukov sequence-per-cell scheme).
+// Any number of producers may push concurrently; pops are safe from any
+// thread but the mailbox only pops from its owning task.
+class MailboxRing {
+  public:
+    explicit MailboxRing(size_t capacity);
+
+    // env is only moved from when the push succeeds.
+    bool try_push(MailboxEnvelope&& env);
+    bool try_pop(MailboxEnvelope& out);
+
+    size_t capacity() const;
+    bool empty() const;
+    // Approximate while producers or the consumer are active.
+    size_t size() const;
+
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        MailboxEnvelope env;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueuePos_;
+    alignas(64) std::atomic<size_t> dequeuePos_;
+};
+
+} // namespace AIOTEK
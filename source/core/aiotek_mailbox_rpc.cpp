@@ -0,0 +1,144 @@
+#include "aiotek_mailbox_rpc.hpp"
+#include "aiotek_log.hpp"
+
+namespace AIOTEK {
+
+MailboxRpcError::MailboxRpcError(MailboxStatus status)
+    : std::runtime_error(std::string("Mailbox call failed: ") + MailboxStatusToString(status)), status_(status)
+{
+}
+
+MailboxStatus MailboxRpcError::status() const
+{
+    return status_;
+}
+
+MailboxRpc::MailboxRpc(MailboxRegistry& registry) : registry_(registry)
+{
+}
+
+MailboxRpc::~MailboxRpc()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+std::future<MailboxMessage> MailboxRpc::call(TaskID caller, TaskID receiver, MailboxMessage request, std::chrono::milliseconds timeout)
+{
+    uint32_t correlation = nextCorrelation_.fetch_add(1, std::memory_order_relaxed);
+    if (correlation == 0) // 0 means "not a call"; skip it on wrap-around
+        correlation = nextCorrelation_.fetch_add(1, std::memory_order_relaxed);
+
+    auto now = Clock::now();
+    auto deadline = timeout >= std::chrono::duration_cast<std::chrono::milliseconds>(Clock::time_point::max() - now) ? Clock::time_point::max() : now + timeout;
+    std::future<MailboxMessage> future;
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        expireLocked(now);
+        PendingCall& entry = pending_[correlation];
+        entry.deadline = deadline;
+        future = entry.promise.get_future();
+        if (deadline < nextDeadline_) {
+            nextDeadline_ = deadline;
+            wake = true;
+        }
+        // Started on first use rather than at static init.
+        if (wake && !thread_.joinable() && !stopping_)
+            thread_ = std::thread(&MailboxRpc::run, this);
+    }
+    if (wake)
+        cond_.notify_one();
+
+    MailboxEnvelope env(caller, receiver, std::move(request));
+    env.flags |= kEnvelopeRequest;
+    env.correlation = correlation;
+    // Don't let the callee work on a request its caller has given up on.
+    if (timeout <= kMailboxMaxTtl)
+        env.expire_after(timeout);
+    MailboxStatus status = registry_.send(std::move(env));
+    if (status != MailboxStatus::Ok) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pending_.find(correlation);
+        // Fail the call right away, unless a concurrent sweep already has.
+        if (it != pending_.end()) {
+            it->second.promise.set_exception(std::make_exception_ptr(MailboxRpcError(status)));
+            pending_.erase(it);
+        }
+    }
+    return future;
+}
+
+bool MailboxRpc::reply(const MailboxEnvelope& request, MailboxMessage response)
+{
+    if (!(request.flags & kEnvelopeRequest))
+        return false;
+    std::promise<MailboxMessage> promise;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        expireLocked(Clock::now());
+        auto it = pending_.find(request.correlation);
+        if (it == pending_.end()) {
+            AIOTEK_LOG_DEBUG(std::string("MailboxRpc: Late reply from ") + TaskIDToString(request.receiver) + " to " + TaskIDToString(request.sender) + " discarded");
+            return false;
+        }
+        promise = std::move(it->second.promise);
+        pending_.erase(it);
+    }
+    // Outside the lock: set_value() wakes the caller.
+    promise.set_value(std::move(response));
+    return true;
+}
+
+size_t MailboxRpc::expire()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return expireLocked(Clock::now());
+}
+
+size_t MailboxRpc::expireLocked(Clock::time_point now)
+{
+    if (now < nextDeadline_)
+        return 0;
+    size_t expired = 0;
+    nextDeadline_ = Clock::time_point::max();
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (it->second.deadline <= now) {
+            it->second.promise.set_exception(std::make_exception_ptr(MailboxRpcError(MailboxStatus::Timeout)));
+            it = pending_.erase(it);
+            ++expired;
+        } else {
+            if (it->second.deadline < nextDeadline_)
+                nextDeadline_ = it->second.deadline;
+            ++it;
+        }
+    }
+    return expired;
+}
+
+void MailboxRpc::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        expireLocked(Clock::now());
+        if (nextDeadline_ == Clock::time_point::max())
+            cond_.wait(lock);
+        else
+            cond_.wait_until(lock, nextDeadline_);
+    }
+}
+
+size_t MailboxRpc::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+MailboxRpc g_rpc(g_mailboxes);
+
+} // namespace AIOTEK
@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include "aiotek_mailbox.hpp"
+
+namespace AIOTEK {
+
+// Set on a call's future when the request could not be delivered or no
+// reply arrived before its deadline.
+class MailboxRpcError : public std::runtime_error {
+  public:
+    explicit MailboxRpcError(MailboxStatus status);
+    MailboxStatus status() const;
+
+  private:
+    MailboxStatus status_;
+};
+
+// Request/response on top of the mailbox registry. call() sends the request
+// as an ordinary envelope flagged kEnvelopeRequest with a fresh correlation
+// id, and returns a future for the reply. The callee handles it in its
+// normal receive loop and answers with reply(), which completes the
+// caller's promise directly: it never blocks and never waits for room in
+// the caller's mailbox.
+//
+//   auto snapshot = g_rpc.call(TaskID::MQTT, TaskID::Video, CustomEvent{"video.snapshot", ""}, 500ms);
+//   MailboxMessage frame = snapshot.get(); // throws MailboxRpcError
+//
+// Calls that outlive their timeout fail with MailboxRpcError(Timeout) at
+// their deadline: a deadline thread, started by the first call() with a
+// finite timeout, sleeps until the earliest one. get() therefore never
+// waits much longer than the timeout. Replies arriving after that are
+// discarded.
+class MailboxRpc {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit MailboxRpc(MailboxRegistry& registry);
+    ~MailboxRpc();
+    MailboxRpc(const MailboxRpc&) = delete;
+    MailboxRpc& operator=(const MailboxRpc&) = delete;
+
+    std::future<MailboxMessage> call(TaskID caller, TaskID receiver, MailboxMessage request, std::chrono::milliseconds timeout);
+
+    // Returns false if request was not a call or its caller gave up.
+    bool reply(const MailboxEnvelope& request, MailboxMessage response);
+
+    // Fails every call past its deadline now; returns how many. The
+    // deadline thread does this on its own.
+    size_t expire();
+
+    size_t pending() const;
+
+  private:
+    struct PendingCall {
+        std::promise<MailboxMessage> promise;
+        Clock::time_point deadline;
+    };
+
+    size_t expireLocked(Clock::time_point now);
+    void run();
+
+    MailboxRegistry& registry_;
+    std::atomic<uint32_t> nextCorrelation_{1};
+    mutable std::mutex mutex_;
+    std::unordered_map<uint32_t, PendingCall> pending_;
+    Clock::time_point nextDeadline_ = Clock::time_point::max();
+    std::condition_variable cond_; // wakes the deadline thread
+    std::thread thread_;
+    bool stopping_ = false;
+};
+
+extern MailboxRpc g_rpc;
+
+} // namespace AIOTEK
@@ -0,0 +1,282 @@
+#include "aiotek_mailbox_scheduler.hpp"
+#include "aiotek_log.hpp"
+
+namespace AIOTEK {
+
+static constexpr uint64_t kIdle = UINT64_MAX;
+
+MailboxScheduler::MailboxScheduler(MailboxRegistry& registry, std::chrono::milliseconds resolution)
+    : registry_(registry), resolution_(resolution.count() > 0 ? resolution : std::chrono::milliseconds(1)), origin_(Clock::now())
+{
+    for (auto& level : wheel_)
+        level.fill(kNil);
+}
+
+MailboxScheduler::~MailboxScheduler()
+{
+    stop();
+}
+
+void MailboxScheduler::start()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_)
+        return;
+    running_ = true;
+    thread_ = std::thread(&MailboxScheduler::run, this);
+}
+
+void MailboxScheduler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_)
+            return;
+        running_ = false;
+    }
+    cond_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+MailboxTimerId MailboxScheduler::send_after(std::chrono::milliseconds delay, MailboxEnvelope env)
+{
+    return schedule(toTicks(delay), 0, std::move(env));
+}
+
+MailboxTimerId MailboxScheduler::send_every(std::chrono::milliseconds period, MailboxEnvelope env)
+{
+    return send_every(period, period, std::move(env));
+}
+
+MailboxTimerId MailboxScheduler::send_every(std::chrono::milliseconds period, std::chrono::milliseconds firstDelay, MailboxEnvelope env)
+{
+    uint64_t periodTicks = toTicks(period);
+    return schedule(toTicks(firstDelay), periodTicks ? periodTicks : 1, std::move(env));
+}
+
+uint64_t MailboxScheduler::toTicks(std::chrono::milliseconds duration) const
+{
+    if (duration.count() <= 0)
+        return 0;
+    // Round up so a delay is never cut short.
+    auto ticks = (std::chrono::duration_cast<Clock::duration>(duration) + resolution_ - Clock::duration(1)) / resolution_;
+    return static_cast<uint64_t>(ticks);
+}
+
+uint64_t MailboxScheduler::ticksUntil(Clock::time_point when) const
+{
+    return when <= origin_ ? 0 : static_cast<uint64_t>((when - origin_) / resolution_);
+}
+
+MailboxTimerId MailboxScheduler::schedule(uint64_t delayTicks, uint64_t periodTicks, MailboxEnvelope&& env)
+{
+    // Count from the next tick boundary: the current tick has partly elapsed.
+    uint64_t expiry = ticksUntil(Clock::now()) + 1 + delayTicks;
+    bool wake;
+    MailboxTimerId id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t index;
+        if (!free_.empty()) {
+            index = free_.back();
+            free_.pop_back();
+        } else {
+            index = static_cast<uint32_t>(nodes_.size());
+            nodes_.emplace_back();
+        }
+        Node& node = nodes_[index];
+        node.expiry = expiry > current_ ? expiry : current_ + 1;
+        node.period = periodTicks;
+        node.active = true;
+        node.env = std::move(env);
+        linkLocked(index);
+        ++active_;
+        wake = node.expiry < wakeTick_;
+        id = (static_cast<uint64_t>(node.generation) << 32) | index;
+    }
+    if (wake)
+        cond_.notify_one();
+    return id;
+}
+
+bool MailboxScheduler::cancel(MailboxTimerId id)
+{
+    auto index = static_cast<uint32_t>(id);
+    auto generation = static_cast<uint32_t>(id >> 32);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index >= nodes_.size() || !nodes_[index].active || nodes_[index].generation != generation)
+        return false;
+    unlinkLocked(index);
+    freeLocked(index);
+    return true;
+}
+
+size_t MailboxScheduler::active() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return active_;
+}
+
+uint64_t MailboxScheduler::dropped() const
+{
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+void MailboxScheduler::linkLocked(uint32_t index)
+{
+    Node& node = nodes_[index];
+    uint64_t diff = node.expiry - current_;
+    size_t level = 0;
+    while (level + 1 < kLevels && diff >= (uint64_t(1) << (kSlotBits * (level + 1))))
+        ++level;
+    // Beyond the top level's reach: park in the farthest slot; the node is
+    // re-linked when that slot cascades.
+    uint64_t placeAt = node.expiry;
+    uint64_t reach = uint64_t(1) << (kSlotBits * kLevels);
+    if (diff >= reach)
+        placeAt = current_ + reach - 1;
+    auto slot = static_cast<size_t>((placeAt >> (kSlotBits * level)) & (kSlots - 1));
+
+    node.slot = static_cast<uint16_t>(level * kSlots + slot);
+    node.prev = kNil;
+    node.next = wheel_[level][slot];
+    if (node.next != kNil)
+        nodes_[node.next].prev = index;
+    wheel_[level][slot] = index;
+}
+
+void MailboxScheduler::unlinkLocked(uint32_t index)
+{
+    Node& node = nodes_[index];
+    if (node.prev != kNil)
+        nodes_[node.prev].next = node.next;
+    else
+        wheel_[node.slot / kSlots][node.slot % kSlots] = node.next;
+    if (node.next != kNil)
+        nodes_[node.next].prev = node.prev;
+    node.prev = node.next = kNil;
+}
+
+void MailboxScheduler::freeLocked(uint32_t index)
+{
+    Node& node = nodes_[index];
+    node.active = false;
+    node.env = MailboxEnvelope(); // release the payload now, not on reuse
+    if (++node.generation == 0)
+        node.generation = 1;
+    free_.push_back(index);
+    --active_;
+}
+
+void MailboxScheduler::cascadeLocked(size_t level)
+{
+    auto slot = static_cast<size_t>((current_ >> (kSlotBits * level)) & (kSlots - 1));
+    uint32_t index = wheel_[level][slot];
+    wheel_[level][slot] = kNil;
+    while (index != kNil) {
+        uint32_t next = nodes_[index].next;
+        linkLocked(index);
+        index = next;
+    }
+}
+
+void MailboxScheduler::advanceLocked(uint64_t nowTick, std::vector<MailboxEnvelope>& due)
+{
+    while (current_ < nowTick) {
+        // Ticks with no occupied slot and no cascade change nothing, so
+        // skip them instead of stepping through an idle stretch one by one.
+        uint64_t event = nextEventTickLocked();
+        if (event > nowTick) {
+            current_ = nowTick;
+            break;
+        }
+        current_ = event;
+        // Entering a new window of level L: pull its slot down, highest
+        // level first, before serving level 0.
+        size_t top = 0;
+        while (top + 1 < kLevels && (current_ & ((uint64_t(1) << (kSlotBits * (top + 1))) - 1)) == 0)
+            ++top;
+        for (size_t level = top; level > 0; --level)
+            cascadeLocked(level);
+
+        auto slot = static_cast<size_t>(current_ & (kSlots - 1));
+        uint32_t index = wheel_[0][slot];
+        wheel_[0][slot] = kNil;
+        while (index != kNil) {
+            Node& node = nodes_[index];
+            uint32_t next = node.next;
+            if (node.period) {
+                due.push_back(node.env);
+                // Stay on the original phase; skip periods already missed.
+                node.expiry += node.period;
+                if (node.expiry <= nowTick)
+                    node.expiry += ((nowTick - node.expiry) / node.period + 1) * node.period;
+                linkLocked(index);
+            } else {
+                due.push_back(std::move(node.env));
+                freeLocked(index);
+            }
+            index = next;
+        }
+    }
+}
+
+uint64_t MailboxScheduler::nextEventTickLocked() const
+{
+    if (active_ == 0)
+        return kIdle;
+    // Next occupied level-0 slot: its nodes are all due within kSlots ticks.
+    uint64_t best = kIdle;
+    for (uint64_t tick = current_ + 1; tick <= current_ + kSlots; ++tick) {
+        if (wheel_[0][tick & (kSlots - 1)] != kNil) {
+            best = tick;
+            break;
+        }
+    }
+    // Next cascade of an occupied slot on each higher level.
+    for (size_t level = 1; level < kLevels; ++level) {
+        uint64_t window = uint64_t(1) << (kSlotBits * level);
+        uint64_t boundary = (current_ / window + 1) * window;
+        for (size_t step = 0; step < kSlots && boundary < best; ++step, boundary += window) {
+            if (wheel_[level][(boundary >> (kSlotBits * level)) & (kSlots - 1)] != kNil) {
+                best = boundary;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+void MailboxScheduler::run()
+{
+    AIOTEK_LOG_DEBUG("MailboxScheduler: Thread started");
+    std::vector<MailboxEnvelope> due;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        advanceLocked(ticksUntil(Clock::now()), due);
+        if (!due.empty()) {
+            // Deliver unlocked, and without waiting: a full Block mailbox
+            // must not hold up every other timer.
+            lock.unlock();
+            for (auto& env : due) {
+                if (registry_.try_send(std::move(env)) != MailboxStatus::Ok)
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+            due.clear();
+            lock.lock();
+            continue;
+        }
+        wakeTick_ = nextEventTickLocked();
+        if (wakeTick_ == kIdle)
+            cond_.wait(lock);
+        else
+            cond_.wait_until(lock, origin_ + resolution_ * static_cast<Clock::rep>(wakeTick_));
+        wakeTick_ = 0;
+    }
+    wakeTick_ = kIdle;
+}
+
+MailboxScheduler g_scheduler(g_mailboxes);
+
+} // namespace AIOTEK
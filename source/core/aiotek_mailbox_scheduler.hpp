@@ -0,0 +1,104 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "aiotek_mailbox.hpp"
+
+namespace AIOTEK {
+
+// 0 is never a valid id.
+using MailboxTimerId = uint64_t;
+
+// Delivers envelopes to a MailboxRegistry after a delay or on a period,
+// from a single thread, instead of every task running its own sleep loop.
+//
+// Timers live in a hierarchical timing wheel (4 levels x 256 slots of
+// `resolution` ticks, ~49 days at 1 ms), so schedule and cancel are O(1)
+// and thousands of timers cost nothing while they wait. Deadlines are
+// absolute ticks on the steady clock: a periodic timer fires at
+// first + n * period no matter how late earlier deliveries were, so it
+// never drifts. If the thread falls more than a period behind, the missed
+// deliveries are skipped rather than sent in a burst. The thread sleeps
+// until the next occupied slot or cascade, not every tick, and catches up
+// after a long sleep by jumping over the ticks where nothing happens.
+//
+// Delivery never blocks the timer thread: envelopes go out through
+// MailboxRegistry::try_send, and the ones a full mailbox refuses are
+// counted in dropped().
+class MailboxScheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit MailboxScheduler(MailboxRegistry& registry, std::chrono::milliseconds resolution = std::chrono::milliseconds(1));
+    ~MailboxScheduler();
+    MailboxScheduler(const MailboxScheduler&) = delete;
+    MailboxScheduler& operator=(const MailboxScheduler&) = delete;
+
+    void start();
+    void stop();
+
+    MailboxTimerId send_after(std::chrono::milliseconds delay, MailboxEnvelope env);
+    // First delivery after `period` unless firstDelay is given.
+    MailboxTimerId send_every(std::chrono::milliseconds period, MailboxEnvelope env);
+    MailboxTimerId send_every(std::chrono::milliseconds period, std::chrono::milliseconds firstDelay, MailboxEnvelope env);
+
+    // Returns false if the timer already fired (one-shot) or was cancelled.
+    bool cancel(MailboxTimerId id);
+
+    size_t active() const;
+    // Due envelopes the receiver refused (full, closed, no receiver).
+    uint64_t dropped() const;
+
+  private:
+    static constexpr size_t kLevels = 4;
+    static constexpr size_t kSlotBits = 8;
+    static constexpr size_t kSlots = size_t(1) << kSlotBits;
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    struct Node {
+        uint64_t expiry = 0; // absolute tick
+        uint64_t period = 0; // ticks, 0 for one-shot
+        uint32_t prev = kNil;
+        uint32_t next = kNil;
+        uint32_t generation = 1;
+        uint16_t slot = 0; // level * kSlots + index
+        bool active = false;
+        MailboxEnvelope env;
+    };
+
+    MailboxTimerId schedule(uint64_t delayTicks, uint64_t periodTicks, MailboxEnvelope&& env);
+    uint64_t ticksUntil(Clock::time_point when) const;
+    uint64_t toTicks(std::chrono::milliseconds duration) const;
+    void linkLocked(uint32_t index);
+    void unlinkLocked(uint32_t index);
+    void freeLocked(uint32_t index);
+    void cascadeLocked(size_t level);
+    void advanceLocked(uint64_t nowTick, std::vector<MailboxEnvelope>& due);
+    uint64_t nextEventTickLocked() const;
+    void run();
+
+    MailboxRegistry& registry_;
+    const Clock::duration resolution_;
+    const Clock::time_point origin_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_;
+    std::array<std::array<uint32_t, kSlots>, kLevels> wheel_;
+    uint64_t current_ = 0;  // last processed tick
+    uint64_t wakeTick_ = 0; // tick the thread sleeps until (UINT64_MAX: idle)
+    size_t active_ = 0;
+    std::atomic<uint64_t> dropped_{0};
+    bool running_ = false;
+    std::thread thread_;
+};
+
+extern MailboxScheduler g_scheduler;
+
+} // namespace AIOTEK
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include "aiotek_mailbox_stats.hpp"
+
+namespace AIOTEK {
+
+static int64_t steadyNowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t MailboxClockUs()
+{
+    return static_cast<uint32_t>(steadyNowUs());
+}
+
+MailboxStats::MailboxStats() : resetAt_(steadyNowUs())
+{
+}
+
+size_t MailboxStats::bucketOf(uint32_t waitUs)
+{
+    size_t bucket = 0;
+    while (waitUs > 1 && bucket < kBuckets - 1) {
+        waitUs >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void MailboxStats::record(TaskID sender, TaskID receiver, uint32_t waitUs)
+{
+    auto s = static_cast<size_t>(sender);
+    auto r = static_cast<size_t>(receiver);
+    if (s >= kTaskCount || r >= kTaskCount)
+        return;
+    Pair& pair = pairs_[s * kTaskCount + r];
+    pair.received.fetch_add(1, std::memory_order_relaxed);
+    pair.buckets[bucketOf(waitUs)].fetch_add(1, std::memory_order_relaxed);
+    uint32_t max = pair.maxUs.load(std::memory_order_relaxed);
+    while (waitUs > max && !pair.maxUs.compare_exchange_weak(max, waitUs, std::memory_order_relaxed)) {
+    }
+}
+
+void MailboxStats::record_expired(TaskID sender, TaskID receiver)
+{
+    auto s = static_cast<size_t>(sender);
+    auto r = static_cast<size_t>(receiver);
+    if (s >= kTaskCount || r >= kTaskCount)
+        return;
+    pairs_[s * kTaskCount + r].expired.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MailboxStats::reset()
+{
+    for (auto& pair : pairs_) {
+        pair.received.store(0, std::memory_order_relaxed);
+        pair.maxUs.store(0, std::memory_order_relaxed);
+        pair.expired.store(0, std::memory_order_relaxed);
+        for (auto& bucket : pair.buckets)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+    resetAt_.store(steadyNowUs(), std::memory_order_relaxed);
+}
+
+double MailboxStats::seconds() const
+{
+    return (steadyNowUs() - resetAt_.load(std::memory_order_relaxed)) / 1000000.0;
+}
+
+uint32_t MailboxStats::percentile(const std::array<uint32_t, kBuckets>& buckets, uint64_t total, double fraction)
+{
+    auto rank = static_cast<uint64_t>(fraction * static_cast<double>(total) + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= rank)
+            return bucket >= 31 ? UINT32_MAX : (uint32_t(2) << bucket) - 1;
+    }
+    return UINT32_MAX;
+}
+
+std::vector<MailboxPairStats> MailboxStats::pairs() const
+{
+    std::vector<MailboxPairStats> result;
+    double elapsed = seconds();
+    for (size_t index = 0; index < pairs_.size(); ++index) {
+        const Pair& pair = pairs_[index];
+        std::array<uint32_t, kBuckets> buckets;
+        uint64_t total = 0;
+        for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+            buckets[bucket] = pair.buckets[bucket].load(std::memory_order_relaxed);
+            total += buckets[bucket];
+        }
+        uint64_t expired = pair.expired.load(std::memory_order_relaxed);
+        if (total == 0 && expired == 0)
+            continue;
+        MailboxPairStats stats;
+        stats.sender = static_cast<TaskID>(index / kTaskCount);
+        stats.receiver = static_cast<TaskID>(index % kTaskCount);
+        stats.received = pair.received.load(std::memory_order_relaxed);
+        stats.throughput = elapsed > 0.0 ? stats.received / elapsed : 0.0;
+        stats.p50Us = percentile(buckets, total, 0.50);
+        stats.p99Us = percentile(buckets, total, 0.99);
+        stats.maxUs = pair.maxUs.load(std::memory_order_relaxed);
+        stats.expired = expired;
+        // The max is exact; don't report a bucket bound above it.
+        stats.p50Us = std::min(stats.p50Us, stats.maxUs);
+        stats.p99Us = std::min(stats.p99Us, stats.maxUs);
+        result.push_back(stats);
+    }
+    return result;
+}
+
+MailboxStatsSnapshot CollectMailboxStats(MailboxRegistry& registry)
+{
+    MailboxStatsSnapshot snapshot;
+    snapshot.seconds = g_mailboxStats.seconds();
+    for (size_t index = 0; index < kTaskCount; ++index) {
+        auto task = static_cast<TaskID>(index);
+        Mailbox& mailbox = registry.get(task);
+        MailboxDepthStats stats;
+        stats.task = task;
+        stats.depth = mailbox.depth();
+        stats.highWatermark = mailbox.high_watermark();
+        stats.counters = mailbox.counters();
+        snapshot.mailboxes.push_back(stats);
+    }
+    snapshot.pairs = g_mailboxStats.pairs();
+    return snapshot;
+}
+
+nlohmann::json MailboxStatsToJson(const MailboxStatsSnapshot& snapshot)
+{
+    nlohmann::json json;
+    json["seconds"] = snapshot.seconds;
+    json["mailboxes"] = nlohmann::json::array();
+    for (const auto& mailbox : snapshot.mailboxes) {
+        if (mailbox.counters.sent == 0 && mailbox.highWatermark == 0)
+            continue;
+        json["mailboxes"].push_back({
+            {"task", TaskIDToString(mailbox.task)},
+            {"depth", mailbox.depth},
+            {"high_watermark", mailbox.highWatermark},
+            {"sent", mailbox.counters.sent},
+            {"received", mailbox.counters.received},
+            {"dropped", mailbox.counters.droppedOldest + mailbox.counters.droppedNewest},
+            {"rejected", mailbox.counters.rejected},
+            {"blocked", mailbox.counters.blocked},
+            {"timed_out", mailbox.counters.timedOut},
+            {"coalesced", mailbox.counters.coalesced},
+            {"expired", mailbox.counters.expired},
+            {"throttled", mailbox.counters.throttled},
+        });
+    }
+    json["pairs"] = nlohmann::json::array();
+    for (const auto& pair : snapshot.pairs) {
+        json["pairs"].push_back({
+            {"sender", TaskIDToString(pair.sender)},
+            {"receiver", TaskIDToString(pair.receiver)},
+            {"received", pair.received},
+            {"throughput", pair.throughput},
+            {"p50_us", pair.p50Us},
+            {"p99_us", pair.p99Us},
+            {"max_us", pair.maxUs},
+            {"expired", pair.expired},
+        });
+    }
+    return json;
+}
+
+std::string MailboxStatsToString(const MailboxStatsSnapshot& snapshot)
+{
+    std::stringstream ss;
+    ss << "Mailbox stats over " << std::fixed << std::setprecision(1) << snapshot.seconds << "s" << std::endl;
+    for (const auto& mailbox : snapshot.mailboxes) {
+        if (mailbox.counters.sent == 0 && mailbox.highWatermark == 0)
+            continue;
+        ss << "  " << std::left << std::setw(10) << TaskIDToString(mailbox.task) << " depth=" << mailbox.depth
+           << " hwm=" << mailbox.highWatermark << " sent=" << mailbox.counters.sent << " recv=" << mailbox.counters.received
+           << " dropped=" << mailbox.counters.droppedOldest + mailbox.counters.droppedNewest << " rejected=" << mailbox.counters.rejected
+           << " blocked=" << mailbox.counters.blocked << " coalesced=" << mailbox.counters.coalesced
+           << " expired=" << mailbox.counters.expired << " throttled=" << mailbox.counters.throttled << std::endl;
+    }
+    for (const auto& pair : snapshot.pairs) {
+        ss << "  " << TaskIDToString(pair.sender) << " -> " << TaskIDToString(pair.receiver) << ": " << pair.received << " msgs "
+           << std::setprecision(1) << pair.throughput << "/s wait p50=" << pair.p50Us << "us p99=" << pair.p99Us
+           << "us max=" << pair.maxUs << "us";
+        if (pair.expired)
+            ss << " expired=" << pair.expired;
+        ss << std::endl;
+    }
+    return ss.str();
+}
+
+MailboxStats g_mailboxStats;
+
+} // namespace AIOTEK
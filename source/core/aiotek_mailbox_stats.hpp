@@ -0,0 +1,81 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "aiotek_mailbox.hpp"
+
+namespace AIOTEK {
+
+// Monotonic microseconds, truncated to 32 bits. Differences are taken with
+// unsigned wrap-around, so waits up to ~71 minutes are measured correctly.
+uint32_t MailboxClockUs();
+
+struct MailboxPairStats {
+    TaskID sender = TaskID::Unknown;
+    TaskID receiver = TaskID::Unknown;
+    uint64_t received = 0;
+    double throughput = 0.0; // envelopes per second since reset()
+    uint32_t p50Us = 0;      // wait in the mailbox, send() to dequeue
+    uint32_t p99Us = 0;
+    uint32_t maxUs = 0;
+    uint64_t expired = 0; // dropped unread because their ttl ran out
+};
+
+struct MailboxDepthStats {
+    TaskID task = TaskID::Unknown;
+    size_t depth = 0;
+    size_t highWatermark = 0;
+    MailboxCounters counters;
+};
+
+struct MailboxStatsSnapshot {
+    double seconds = 0.0; // since reset()
+    std::vector<MailboxDepthStats> mailboxes;
+    std::vector<MailboxPairStats> pairs; // only pairs that carried traffic
+};
+
+// Enqueue-to-dequeue wait histograms per (sender, receiver) pair. Buckets
+// are powers of two in microseconds; percentiles report the bucket's upper
+// bound. Recording is lock-free.
+class MailboxStats {
+  public:
+    static constexpr size_t kBuckets = 32;
+
+    MailboxStats();
+
+    void record(TaskID sender, TaskID receiver, uint32_t waitUs);
+    void record_expired(TaskID sender, TaskID receiver);
+    void reset();
+
+    std::vector<MailboxPairStats> pairs() const;
+    double seconds() const;
+
+  private:
+    struct Pair {
+        std::atomic<uint64_t> received{0};
+        std::atomic<uint32_t> maxUs{0};
+        std::atomic<uint64_t> expired{0};
+        std::array<std::atomic<uint32_t>, kBuckets> buckets{};
+    };
+
+    static size_t bucketOf(uint32_t waitUs);
+    static uint32_t percentile(const std::array<uint32_t, kBuckets>& buckets, uint64_t total, double fraction);
+
+    std::array<Pair, kTaskCount * kTaskCount> pairs_;
+    std::atomic<int64_t> resetAt_;
+};
+
+extern MailboxStats g_mailboxStats;
+
+// Depth, high-watermark and counters of every registry mailbox plus the
+// per-pair wait statistics, for the console and the status publisher.
+MailboxStatsSnapshot CollectMailboxStats(MailboxRegistry& registry = g_mailboxes);
+
+nlohmann::json MailboxStatsToJson(const MailboxStatsSnapshot& snapshot);
+std::string MailboxStatsToString(const MailboxStatsSnapshot& snapshot);
+
+} // namespace AIOTEK
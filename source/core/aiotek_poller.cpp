@@ -0,0 +1,59 @@
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include "aiotek_poller.hpp"
+#include "aiotek_log.hpp"
+
+namespace AIOTEK {
+
+static constexpr int kMaxEvents = 16;
+
+EventPoller::EventPoller() : epollFd_(::epoll_create1(EPOLL_CLOEXEC))
+{
+    if (epollFd_ < 0)
+        AIOTEK_LOG_ERROR("EventPoller: epoll_create1() failed");
+}
+
+EventPoller::~EventPoller()
+{
+    if (epollFd_ >= 0)
+        ::close(epollFd_);
+}
+
+bool EventPoller::valid() const
+{
+    return epollFd_ >= 0;
+}
+
+bool EventPoller::add(int fd, uint64_t tag, uint32_t events)
+{
+    if (epollFd_ < 0 || fd < 0)
+        return false;
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = tag;
+    return ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool EventPoller::remove(int fd)
+{
+    if (epollFd_ < 0 || fd < 0)
+        return false;
+    return ::epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr) == 0;
+}
+
+int EventPoller::wait(std::vector<epoll_event>& ready, std::chrono::milliseconds timeout)
+{
+    ready.resize(kMaxEvents);
+    int timeoutMs = -1;
+    if (timeout.count() >= 0)
+        timeoutMs = timeout.count() > INT_MAX ? INT_MAX : static_cast<int>(timeout.count());
+    int count;
+    do {
+        count = ::epoll_wait(epollFd_, ready.data(), kMaxEvents, timeoutMs);
+    } while (count < 0 && errno == EINTR);
+    ready.resize(count > 0 ? count : 0);
+    return count;
+}
+
+} // namespace AIOTEK
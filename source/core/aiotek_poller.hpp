@@ -0,0 +1,32 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <sys/epoll.h>
+
+namespace AIOTEK {
+
+// Thin RAII wrapper around epoll, so a task can wait on its mailbox
+// readiness fd (Mailbox::readiness_fd()) together with device or socket
+// fds instead of sleep-polling.
+class EventPoller {
+  public:
+    EventPoller();
+    ~EventPoller();
+    EventPoller(const EventPoller&) = delete;
+    EventPoller& operator=(const EventPoller&) = delete;
+
+    bool valid() const;
+    // tag is handed back in epoll_event::data.u64 when fd is ready.
+    bool add(int fd, uint64_t tag, uint32_t events = EPOLLIN | EPOLLET);
+    bool remove(int fd);
+
+    // Returns the number of ready events (0 on timeout, -1 on error).
+    // A negative timeout waits forever.
+    int wait(std::vector<epoll_event>& ready, std::chrono::milliseconds timeout);
+
+  private:
+    int epollFd_;
+};
+
+} // namespace AIOTEK
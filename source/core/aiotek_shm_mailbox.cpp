@@ -0,0 +1,433 @@
+#include <algorithm>
+#include <climits>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "aiotek_shm_mailbox.hpp"
+#include "aiotek_mailbox_codec.hpp"
+#include "aiotek_mailbox_stats.hpp"
+#include "aiotek_log.hpp"
+
+namespace AIOTEK {
+
+namespace detail {
+
+// Lives at the start of the segment; the slots follow it. Only fixed-width
+// fields and lock-free 32-bit atomics, so 32- and 64-bit processes agree
+// on the layout and futexes can wait on the counters directly.
+struct ShmMailboxHeader {
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t capacity;   // slots, power of two
+    uint32_t slotStride; // bytes per slot including ShmSlot
+    alignas(64) std::atomic<uint32_t> enqueuePos;
+    alignas(64) std::atomic<uint32_t> dequeuePos;
+    alignas(64) std::atomic<uint32_t> dataSignal; // bumped after every push
+    std::atomic<uint32_t> dataWaiters;
+    std::atomic<uint32_t> spaceSignal; // bumped after every pop
+    std::atomic<uint32_t> spaceWaiters;
+    std::atomic<uint32_t> closed;
+};
+
+struct ShmSlot {
+    std::atomic<uint32_t> sequence;
+    uint32_t length;
+};
+
+} // namespace detail
+
+using detail::ShmMailboxHeader;
+using detail::ShmSlot;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "futex words must be plain 32-bit integers");
+
+static constexpr uint32_t kShmMagic = 0x4d424f58; // "MBOX"
+static constexpr uint32_t kShmVersion = 1;
+static constexpr size_t kShmHeaderSize = (sizeof(ShmMailboxHeader) + 63) & ~size_t(63);
+static constexpr size_t kMaxShmCapacity = size_t(1) << 20;
+
+static size_t roundUpPowerOfTwo(size_t value)
+{
+    size_t result = 2;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+static std::string segmentName(const std::string& name)
+{
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+// Sleeps while word still holds seen, until woken or deadline. Returns
+// false only when the deadline has passed.
+static bool futexWaitUntil(std::atomic<uint32_t>& word, uint32_t seen, ShmMailbox::Clock::time_point deadline)
+{
+    timespec remaining{};
+    timespec* timeout = nullptr;
+    if (deadline != ShmMailbox::Clock::time_point::max()) {
+        auto now = ShmMailbox::Clock::now();
+        if (now >= deadline)
+            return false;
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count();
+        remaining.tv_sec = static_cast<time_t>(ns / 1000000000);
+        remaining.tv_nsec = static_cast<long>(ns % 1000000000);
+        timeout = &remaining;
+    }
+    // Shared (not FUTEX_PRIVATE) so waiters in other processes are found.
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, seen, timeout, nullptr, 0);
+    return true;
+}
+
+static void futexWakeAll(std::atomic<uint32_t>& word)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// Bump the signal word, then wake only if someone announced a wait. The
+// seq_cst pair orders the bump against the waiter's announcement, so a
+// waiter either sees the new value or is woken.
+static void signalWaiters(std::atomic<uint32_t>& signal, std::atomic<uint32_t>& waiters)
+{
+    signal.fetch_add(1, std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_seq_cst) != 0)
+        futexWakeAll(signal);
+}
+
+static ShmMailbox::Clock::time_point deadlineAfter(std::chrono::milliseconds timeout)
+{
+    auto now = ShmMailbox::Clock::now();
+    if (timeout >= std::chrono::duration_cast<std::chrono::milliseconds>(ShmMailbox::Clock::time_point::max() - now))
+        return ShmMailbox::Clock::time_point::max();
+    return now + timeout;
+}
+
+ShmMailbox::~ShmMailbox()
+{
+    detach();
+}
+
+void ShmMailbox::detach()
+{
+    unmap();
+    if (owner_)
+        ::shm_unlink(name_.c_str());
+    owner_ = false;
+}
+
+bool ShmMailbox::create(const std::string& name, const ShmMailboxConfig& config)
+{
+    detach();
+    config_ = config;
+    config_.capacity = roundUpPowerOfTwo(config.capacity ? std::min(config.capacity, kMaxShmCapacity) : kDefaultRingCapacity);
+    name_ = segmentName(name);
+
+    // A segment left behind by a crashed run would carry stale positions.
+    ::shm_unlink(name_.c_str());
+    int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        AIOTEK_LOG_ERROR("ShmMailbox: shm_open(" + name_ + ") failed");
+        return false;
+    }
+    owner_ = true;
+    bool ok = map(fd, true);
+    ::close(fd);
+    return ok;
+}
+
+bool ShmMailbox::open(const std::string& name, const ShmMailboxConfig& config)
+{
+    detach();
+    config_ = config;
+    name_ = segmentName(name);
+    int fd = ::shm_open(name_.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    bool ok = map(fd, false);
+    ::close(fd);
+    return ok;
+}
+
+bool ShmMailbox::map(int fd, bool initialize)
+{
+    size_t slotStride = (sizeof(ShmSlot) + config_.slotSize + 63) & ~size_t(63);
+    size_t size = kShmHeaderSize + config_.capacity * slotStride;
+    if (initialize) {
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            AIOTEK_LOG_ERROR("ShmMailbox: ftruncate(" + name_ + ") failed");
+            return false;
+        }
+    } else {
+        struct stat info {};
+        if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < kShmHeaderSize)
+            return false;
+        size = static_cast<size_t>(info.st_size);
+    }
+
+    void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        AIOTEK_LOG_ERROR("ShmMailbox: mmap(" + name_ + ") failed");
+        return false;
+    }
+    header_ = static_cast<ShmMailboxHeader*>(base);
+    mappedSize_ = size;
+
+    if (initialize) {
+        // ftruncate() zero-filled the segment; set the non-zero fields and
+        // publish the magic last so open() never sees a half-built ring.
+        header_->version = kShmVersion;
+        header_->capacity = static_cast<uint32_t>(config_.capacity);
+        header_->slotStride = static_cast<uint32_t>(slotStride);
+        for (uint32_t i = 0; i < header_->capacity; ++i)
+            reinterpret_cast<ShmSlot*>(slotAt(i))->sequence.store(i, std::memory_order_relaxed);
+        header_->magic.store(kShmMagic, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t capacity = header_->capacity;
+    if (header_->magic.load(std::memory_order_acquire) != kShmMagic || header_->version != kShmVersion
+        || capacity < 2 || (capacity & (capacity - 1)) != 0 || header_->slotStride <= sizeof(ShmSlot)
+        || kShmHeaderSize + size_t(header_->capacity) * header_->slotStride != size) {
+        AIOTEK_LOG_ERROR("ShmMailbox: " + name_ + " is not a compatible mailbox segment");
+        unmap();
+        return false;
+    }
+    config_.capacity = header_->capacity;
+    config_.slotSize = header_->slotStride - sizeof(ShmSlot);
+    return true;
+}
+
+void ShmMailbox::unmap()
+{
+    if (header_)
+        ::munmap(header_, mappedSize_);
+    header_ = nullptr;
+    mappedSize_ = 0;
+}
+
+bool ShmMailbox::valid() const
+{
+    return header_ != nullptr;
+}
+
+uint8_t* ShmMailbox::slotAt(uint32_t position) const
+{
+    return reinterpret_cast<uint8_t*>(header_) + kShmHeaderSize + size_t(position & (header_->capacity - 1)) * header_->slotStride;
+}
+
+bool ShmMailbox::canPush() const
+{
+    uint32_t pos = header_->enqueuePos.load(std::memory_order_relaxed);
+    return reinterpret_cast<ShmSlot*>(slotAt(pos))->sequence.load(std::memory_order_acquire) == pos;
+}
+
+bool ShmMailbox::canPop() const
+{
+    uint32_t pos = header_->dequeuePos.load(std::memory_order_relaxed);
+    return reinterpret_cast<ShmSlot*>(slotAt(pos))->sequence.load(std::memory_order_acquire) == pos + 1;
+}
+
+// Same sequence-per-slot scheme as MailboxRing, with 32-bit positions that
+// wrap; signed differences keep the comparisons right across the wrap.
+bool ShmMailbox::tryPush(const MailboxEnvelope& env, size_t encodedSize)
+{
+    uint32_t pos = header_->enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        auto* slot = reinterpret_cast<ShmSlot*>(slotAt(pos));
+        uint32_t seq = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<int32_t>(seq - pos);
+        if (diff == 0) {
+            if (header_->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                uint8_t* data = reinterpret_cast<uint8_t*>(slot + 1);
+                MailboxEncodeTo(env, data, encodedSize);
+                MailboxWireStamp(data, pos, config_.instrumented || env.ttl ? MailboxClockUs() : 0);
+                slot->length = static_cast<uint32_t>(encodedSize);
+                slot->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = header_->enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool ShmMailbox::tryPop(MailboxEnvelope& out, bool& undecodable)
+{
+    undecodable = false;
+    uint32_t pos = header_->dequeuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        auto* slot = reinterpret_cast<ShmSlot*>(slotAt(pos));
+        uint32_t seq = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<int32_t>(seq - (pos + 1));
+        if (diff == 0) {
+            if (header_->dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                uint32_t length = std::min<uint32_t>(slot->length, header_->slotStride - sizeof(ShmSlot));
+                undecodable = !MailboxDecode(reinterpret_cast<const uint8_t*>(slot + 1), length, out, config_.bufferPool);
+                slot->sequence.store(pos + header_->capacity, std::memory_order_release);
+                signalWaiters(header_->spaceSignal, header_->spaceWaiters);
+                return !undecodable;
+            }
+        } else if (diff < 0) {
+            return false; // empty
+        } else {
+            pos = header_->dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+MailboxStatus ShmMailbox::send(const MailboxEnvelope& env)
+{
+    if (!header_ || header_->closed.load(std::memory_order_acquire))
+        return MailboxStatus::Closed;
+
+    size_t encodedSize = MailboxEncodedSize(env);
+    if (encodedSize > config_.slotSize) {
+        counters_.rejected.fetch_add(1, std::memory_order_relaxed);
+        AIOTEK_LOG_WARNING("ShmMailbox: envelope of " + std::to_string(encodedSize) + " bytes exceeds the slot size of " + name_);
+        return MailboxStatus::Rejected;
+    }
+
+    if (!tryPush(env, encodedSize)) {
+        if (config_.overflow != MailboxOverflow::Block) {
+            counters_.rejected.fetch_add(1, std::memory_order_relaxed);
+            return MailboxStatus::Rejected;
+        }
+        counters_.blocked.fetch_add(1, std::memory_order_relaxed);
+        auto deadline = deadlineAfter(config_.blockTimeout);
+        for (;;) {
+            header_->spaceWaiters.fetch_add(1, std::memory_order_seq_cst);
+            uint32_t seen = header_->spaceSignal.load(std::memory_order_seq_cst);
+            bool inTime = true;
+            if (!canPush() && !header_->closed.load(std::memory_order_acquire))
+                inTime = futexWaitUntil(header_->spaceSignal, seen, deadline);
+            header_->spaceWaiters.fetch_sub(1, std::memory_order_relaxed);
+            if (header_->closed.load(std::memory_order_acquire))
+                return MailboxStatus::Closed;
+            if (tryPush(env, encodedSize))
+                break;
+            if (!inTime) {
+                counters_.timedOut.fetch_add(1, std::memory_order_relaxed);
+                return MailboxStatus::Timeout;
+            }
+        }
+    }
+    counters_.sent.fetch_add(1, std::memory_order_relaxed);
+    signalWaiters(header_->dataSignal, header_->dataWaiters);
+    return MailboxStatus::Ok;
+}
+
+std::optional<MailboxEnvelope> ShmMailbox::receive()
+{
+    return receive_until(Clock::time_point::max());
+}
+
+std::optional<MailboxEnvelope> ShmMailbox::receive_for(std::chrono::milliseconds timeout)
+{
+    return receive_until(deadlineAfter(timeout));
+}
+
+std::optional<MailboxEnvelope> ShmMailbox::receive_until(Clock::time_point deadline)
+{
+    if (!header_)
+        return std::nullopt;
+    for (;;) {
+        if (auto env = try_receive())
+            return env;
+        header_->dataWaiters.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t seen = header_->dataSignal.load(std::memory_order_seq_cst);
+        bool closed = header_->closed.load(std::memory_order_acquire);
+        bool inTime = true;
+        // Checking the head slot rather than the positions means a slot
+        // claimed but not yet filled puts us to sleep, not into a spin.
+        if (!canPop() && !closed)
+            inTime = futexWaitUntil(header_->dataSignal, seen, deadline);
+        header_->dataWaiters.fetch_sub(1, std::memory_order_relaxed);
+        if (closed && !canPop())
+            return std::nullopt;
+        if (!inTime)
+            return try_receive();
+    }
+}
+
+std::optional<MailboxEnvelope> ShmMailbox::try_receive()
+{
+    if (!header_)
+        return std::nullopt;
+    MailboxEnvelope env;
+    bool undecodable = false;
+    for (;;) {
+        if (!tryPop(env, undecodable)) {
+            if (!undecodable)
+                return std::nullopt;
+            counters_.rejected.fetch_add(1, std::memory_order_relaxed);
+            AIOTEK_LOG_WARNING("ShmMailbox: dropped an undecodable envelope from " + name_);
+            continue;
+        }
+        // ttl is enforced at dequeue, as in Mailbox: the sender stamped
+        // every envelope that has one, on the same CLOCK_MONOTONIC.
+        uint32_t nowUs = config_.instrumented || env.ttl ? MailboxClockUs() : 0;
+        if (env.ttl && nowUs - env.enqueued >= uint32_t(env.ttl) * 1000) {
+            counters_.expired.fetch_add(1, std::memory_order_relaxed);
+            g_mailboxStats.record_expired(env.sender, env.receiver);
+            continue;
+        }
+        counters_.received.fetch_add(1, std::memory_order_relaxed);
+        if (config_.instrumented && env.enqueued)
+            g_mailboxStats.record(env.sender, env.receiver, nowUs - env.enqueued);
+        return env;
+    }
+}
+
+void ShmMailbox::close()
+{
+    if (!header_)
+        return;
+    header_->closed.store(1, std::memory_order_release);
+    signalWaiters(header_->dataSignal, header_->dataWaiters);
+    signalWaiters(header_->spaceSignal, header_->spaceWaiters);
+}
+
+bool ShmMailbox::closed() const
+{
+    return !header_ || header_->closed.load(std::memory_order_acquire);
+}
+
+MailboxCounters ShmMailbox::counters() const
+{
+    MailboxCounters counters;
+    counters.sent = counters_.sent.load(std::memory_order_relaxed);
+    counters.received = counters_.received.load(std::memory_order_relaxed);
+    counters.rejected = counters_.rejected.load(std::memory_order_relaxed);
+    counters.blocked = counters_.blocked.load(std::memory_order_relaxed);
+    counters.timedOut = counters_.timedOut.load(std::memory_order_relaxed);
+    counters.expired = counters_.expired.load(std::memory_order_relaxed);
+    return counters;
+}
+
+size_t ShmMailbox::depth() const
+{
+    if (!header_)
+        return 0;
+    uint32_t dequeued = header_->dequeuePos.load(std::memory_order_acquire);
+    uint32_t enqueued = header_->enqueuePos.load(std::memory_order_acquire);
+    auto diff = static_cast<int32_t>(enqueued - dequeued);
+    return diff > 0 ? static_cast<size_t>(diff) : 0;
+}
+
+size_t ShmMailbox::capacity() const
+{
+    return header_ ? header_->capacity : 0;
+}
+
+size_t ShmMailbox::slot_size() const
+{
+    return header_ ? config_.slotSize : 0;
+}
+
+} // namespace AIOTEK
@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include "aiotek_mailbox.hpp"
+
+namespace AIOTEK {
+
+namespace detail {
+struct ShmMailboxHeader;
+}
+
+struct ShmMailboxConfig {
+    // Slots in the shared ring, rounded up to a power of two. Fixed by the
+    // creating process; open() takes them from the segment.
+    size_t capacity = kDefaultRingCapacity;
+    // Bytes per slot. An envelope whose MailboxEncodedSize() exceeds this
+    // is rejected. Also fixed by the creator.
+    size_t slotSize = 4096;
+    // What this process's send() does when the ring is full. Only Block and
+    // Reject are supported; evicting another process's envelope is not.
+    MailboxOverflow overflow = MailboxOverflow::Block;
+    std::chrono::milliseconds blockTimeout = kMailboxWaitForever;
+    // Blocks for decoded BufferEvent payloads. Without it, BufferEvents
+    // received by this process are dropped (and counted as rejected).
+    BufferPool* bufferPool = nullptr;
+    // Stamp envelopes on send and feed wait times into g_mailboxStats.
+    // Both sides use CLOCK_MONOTONIC, so stamps compare across processes.
+    // Envelopes with a ttl are stamped regardless, and dropped at receive
+    // once it has run out, as in Mailbox.
+    bool instrumented = true;
+};
+
+// Mailbox shared between processes through a POSIX shared-memory segment.
+// Envelopes are copied into the segment with the stable MailboxCodec
+// encoding and woken up with futexes, so no socket copies or syscalls are
+// paid while the consumer is busy. The segment holds a bounded MPMC ring:
+// any number of processes may send, one process should receive.
+//
+// A process that dies between claiming a slot and filling it stalls the
+// ring for everyone; restart both sides in that case.
+class ShmMailbox {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    ShmMailbox() = default;
+    ~ShmMailbox();
+    ShmMailbox(const ShmMailbox&) = delete;
+    ShmMailbox& operator=(const ShmMailbox&) = delete;
+
+    // Creates (replacing any stale segment of that name) and maps the
+    // segment /name. The creating process unlinks it again on destruction.
+    bool create(const std::string& name, const ShmMailboxConfig& config = {});
+    // Maps a segment created by another process.
+    bool open(const std::string& name, const ShmMailboxConfig& config = {});
+    bool valid() const;
+
+    MailboxStatus send(const MailboxEnvelope& env);
+
+    std::optional<MailboxEnvelope> receive();
+    std::optional<MailboxEnvelope> receive_for(std::chrono::milliseconds timeout);
+    std::optional<MailboxEnvelope> receive_until(Clock::time_point deadline);
+    std::optional<MailboxEnvelope> try_receive();
+
+    // Closes the mailbox for every process attached to it.
+    void close();
+    bool closed() const;
+
+    // Counters of this process's side only.
+    MailboxCounters counters() const;
+    size_t depth() const;
+    size_t capacity() const;
+    size_t slot_size() const;
+
+  private:
+    struct AtomicCounters {
+        std::atomic<uint64_t> sent{0};
+        std::atomic<uint64_t> received{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> blocked{0};
+        std::atomic<uint64_t> timedOut{0};
+        std::atomic<uint64_t> expired{0};
+    };
+
+    bool map(int fd, bool initialize);
+    void unmap();
+    void detach();
+    bool tryPush(const MailboxEnvelope& env, size_t encodedSize);
+    bool tryPop(MailboxEnvelope& out, bool& undecodable);
+    bool canPush() const;
+    bool canPop() const;
+    uint8_t* slotAt(uint32_t position) const;
+
+    detail::ShmMailboxHeader* header_ = nullptr;
+    size_t mappedSize_ = 0;
+    std::string name_;
+    bool owner_ = false;
+    ShmMailboxConfig config_;
+    AtomicCounters counters_;
+};
+
+} // namespace AIOTEK
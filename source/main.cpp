@@ -1,6 +1,7 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <cstdlib>
 #include <signal.h>
 
 #include "aiotek_log.hpp"
@@ -46,5 +47,10 @@ int main()
     }
     AIOTEK::managers.stop();
     std::cout << "iCamera stopped" << std::endl;
+    // A task still stopping (the console blocks on stdin) keeps running
+    // code, and ~ManagersTask would wait for it: skip static destruction.
+    if (!AIOTEK::managers.stuckTasks().empty()) {
+        std::quick_exit(0);
+    }
     return 0;
 }